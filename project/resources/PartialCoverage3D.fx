@@ -18,20 +18,20 @@ RasterizerState gRasterizerState
 SamplerState gSamplePoint : SampleState
 {
     Filter = MIN_MAG_MIP_POINT;
-    AddressU = Wrap;
-    AddressV = Wrap;
+    AddressU = Clamp;
+    AddressV = Clamp;
 };
 SamplerState gSampleLinear : SampleState
 {
     Filter = MIN_MAG_MIP_LINEAR;
-    AddressU = Wrap;
-    AddressV = Wrap;
+    AddressU = Clamp;
+    AddressV = Clamp;
 };
 SamplerState gSampleAni : SampleState
 {
     Filter = ANISOTROPIC;
-    AddressU = Wrap;
-    AddressV = Wrap;
+    AddressU = Clamp;
+    AddressV = Clamp;
 };
 
 // Blending
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include "MathHelpers.h"
 
 namespace dae
@@ -109,6 +110,15 @@ namespace dae
 		return c * s;
 	}
 
+	// Linear interpolation of two packed 8 bit per channel colors, weight is out of 256 (0 is a, 256 is b).
+	// Two channels per 32 bit lane at a time, so the products never overflow into the next channel.
+	[[nodiscard]] inline uint32_t LerpPackedColor(uint32_t a, uint32_t b, uint32_t weight) noexcept
+	{
+		uint32_t const evenChannels{ (((a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight) >> 8) & 0x00FF00FF };
+		uint32_t const oddChannels{ ((((a >> 8) & 0x00FF00FF) * (256 - weight) + ((b >> 8) & 0x00FF00FF) * weight) >> 8) & 0x00FF00FF };
+		return evenChannels | (oddChannels << 8);
+	}
+
 	namespace colors
 	{
 		static ColorRGB Red{ 1,0,0 };
@@ -0,0 +1,191 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Matrix.h"
+#include "SIMD.h"
+
+namespace dae
+{
+	// Points with a positive distance are on the inside
+	struct Plane
+	{
+		Vector3 normal{};
+		float distance{};
+
+		[[nodiscard]] float GetSignedDistance(Vector3 const& p) const noexcept
+		{
+			return Vector3::Dot(normal, p) + distance;
+		}
+	};
+
+	struct BoundingSphere
+	{
+		Vector3 center{};
+		float radius{};
+	};
+
+	struct BoundingBox
+	{
+		Vector3 center{};
+		Vector3 extents{}; // Half the size along every axis
+	};
+
+	// Bounds of a transformed object: the box stays axis aligned by growing it to fit the rotated box (Arvo)
+	[[nodiscard]] inline BoundingSphere TransformSphere(BoundingSphere const& sphere, Matrix const& m) noexcept
+	{
+		float const scale{ std::max(m.GetAxisX().Magnitude(), std::max(m.GetAxisY().Magnitude(), m.GetAxisZ().Magnitude())) };
+		return { m.TransformPoint(sphere.center), sphere.radius * scale };
+	}
+	[[nodiscard]] inline BoundingBox TransformBox(BoundingBox const& box, Matrix const& m) noexcept
+	{
+		BoundingBox transformed{ m.TransformPoint(box.center), {} };
+		for (int c{ 0 }; c < 3; ++c)
+		{
+			transformed.extents[c] = std::abs(m[0][c]) * box.extents.x + std::abs(m[1][c]) * box.extents.y + std::abs(m[2][c]) * box.extents.z;
+		}
+		return transformed;
+	}
+
+	// Clipping planes of a (world) view projection matrix, in the space the matrix transforms from.
+	// Extracted from the matrix columns (Gribb & Hartmann), with the D3D depth range 0 <= z <= w.
+	struct Frustum
+	{
+		explicit Frustum(Matrix const& m) noexcept
+		{
+			// Plane from a combination of the clip space x, y, z and w (the columns of the matrix)
+			auto const createPlane = [&m](float x, float y, float z, float w)
+				{
+					Plane plane{};
+					plane.normal.x = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3] * w;
+					plane.normal.y = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3] * w;
+					plane.normal.z = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3] * w;
+					plane.distance = m[3][0] * x + m[3][1] * y + m[3][2] * z + m[3][3] * w;
+
+					float const length{ plane.normal.Magnitude() };
+					plane.normal /= length;
+					plane.distance /= length;
+					return plane;
+				};
+
+			planes[0] = createPlane(0.f, 0.f, 1.f, 0.f); // Near: z >= 0
+			planes[1] = createPlane(0.f, 0.f, -1.f, 1.f); // Far: z <= w
+			planes[2] = createPlane(1.f, 0.f, 0.f, 1.f); // Left: x >= -w
+			planes[3] = createPlane(-1.f, 0.f, 0.f, 1.f); // Right: x <= w
+			planes[4] = createPlane(0.f, 1.f, 0.f, 1.f); // Bottom: y >= -w
+			planes[5] = createPlane(0.f, -1.f, 0.f, 1.f); // Top: y <= w
+		}
+
+		[[nodiscard]] bool IsSphereOutside(Vector3 const& center, float radius) const noexcept
+		{
+			for (Plane const& plane : planes)
+			{
+				if (plane.GetSignedDistance(center) < -radius)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		Plane planes[6]{};
+	};
+
+	// True when every triangle within the normal cone faces away from the camera, for any point in the bounding sphere.
+	// Front faces have their geometric normal pointing towards the camera (clockwise winding in a left-handed system).
+	[[nodiscard]] inline bool IsConeBackFacing(Vector3 const& center, float radius, Vector3 const& coneAxis, float coneCutoff, Vector3 const& cameraPosition) noexcept
+	{
+		Vector3 const toCenter{ center - cameraPosition };
+		return Vector3::Dot(toCenter, coneAxis) >= coneCutoff * toCenter.Magnitude() + radius;
+	}
+
+	// Bounds of many objects split up per component, so simd::WIDTH of them are tested against a plane at once.
+	// Arrays are padded to a multiple of simd::WIDTH, the padding is never reported as visible.
+	struct BoundsStream
+	{
+		void Resize(size_t objectCount)
+		{
+			count = objectCount;
+			size_t const paddedCount{ (count + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH };
+			for (auto* pComponent : { &sphereX, &sphereY, &sphereZ, &radius, &boxX, &boxY, &boxZ, &extentX, &extentY, &extentZ })
+			{
+				pComponent->resize(paddedCount);
+			}
+		}
+
+		void Set(size_t i, BoundingSphere const& sphere, BoundingBox const& box) noexcept
+		{
+			sphereX[i] = sphere.center.x;
+			sphereY[i] = sphere.center.y;
+			sphereZ[i] = sphere.center.z;
+			radius[i] = sphere.radius;
+			boxX[i] = box.center.x;
+			boxY[i] = box.center.y;
+			boxZ[i] = box.center.z;
+			extentX[i] = box.extents.x;
+			extentY[i] = box.extents.y;
+			extentZ[i] = box.extents.z;
+		}
+
+		size_t count{};
+
+		std::vector<float> sphereX{};
+		std::vector<float> sphereY{};
+		std::vector<float> sphereZ{};
+		std::vector<float> radius{};
+		std::vector<float> boxX{};
+		std::vector<float> boxY{};
+		std::vector<float> boxZ{};
+		std::vector<float> extentX{};
+		std::vector<float> extentY{};
+		std::vector<float> extentZ{};
+	};
+
+	// An object is culled when its sphere or its box is completely behind one of the planes, whichever is tighter.
+	// isVisible[i] is written for every object in the stream.
+	inline void CullBounds(Frustum const& frustum, BoundsStream const& bounds, std::vector<bool>& isVisible)
+	{
+		isVisible.resize(bounds.count);
+		for (size_t i{ 0 }; i < bounds.count; i += simd::WIDTH)
+		{
+			simd::Float const sphereX{ simd::Load(&bounds.sphereX[i]) };
+			simd::Float const sphereY{ simd::Load(&bounds.sphereY[i]) };
+			simd::Float const sphereZ{ simd::Load(&bounds.sphereZ[i]) };
+			simd::Float const negativeRadius{ simd::Sub(simd::SetFloat(0.f), simd::Load(&bounds.radius[i])) };
+			simd::Float const boxX{ simd::Load(&bounds.boxX[i]) };
+			simd::Float const boxY{ simd::Load(&bounds.boxY[i]) };
+			simd::Float const boxZ{ simd::Load(&bounds.boxZ[i]) };
+			simd::Float const extentX{ simd::Load(&bounds.extentX[i]) };
+			simd::Float const extentY{ simd::Load(&bounds.extentY[i]) };
+			simd::Float const extentZ{ simd::Load(&bounds.extentZ[i]) };
+
+			simd::Int outside{ simd::SetInt(0) };
+			for (Plane const& plane : frustum.planes)
+			{
+				simd::Float const normalX{ simd::SetFloat(plane.normal.x) };
+				simd::Float const normalY{ simd::SetFloat(plane.normal.y) };
+				simd::Float const normalZ{ simd::SetFloat(plane.normal.z) };
+				simd::Float const distance{ simd::SetFloat(plane.distance) };
+
+				// Sphere: center distance < -radius
+				simd::Float const sphereDistance{ simd::Add(simd::Add(simd::Mul(normalX, sphereX), simd::Mul(normalY, sphereY)), simd::Add(simd::Mul(normalZ, sphereZ), distance)) };
+				outside = simd::Or(outside, simd::Less(sphereDistance, negativeRadius));
+
+				// Box: center distance < -(extents projected on the normal)
+				simd::Float const boxDistance{ simd::Add(simd::Add(simd::Mul(normalX, boxX), simd::Mul(normalY, boxY)), simd::Add(simd::Mul(normalZ, boxZ), distance)) };
+				simd::Float const projectedExtent{ simd::Add(simd::Add(
+					simd::Mul(simd::SetFloat(std::abs(plane.normal.x)), extentX),
+					simd::Mul(simd::SetFloat(std::abs(plane.normal.y)), extentY)),
+					simd::Mul(simd::SetFloat(std::abs(plane.normal.z)), extentZ)) };
+				outside = simd::Or(outside, simd::Less(simd::Add(boxDistance, projectedExtent), simd::SetFloat(0.f)));
+			}
+
+			uint32_t const outsideBits{ simd::MoveMask(outside) };
+			for (size_t lane{ 0 }; lane < simd::WIDTH && i + lane < bounds.count; ++lane)
+			{
+				isVisible[i + lane] = !(outsideBits & (1u << lane));
+			}
+		}
+	}
+}
@@ -7,13 +7,6 @@
 
 namespace dae
 {
-	enum class SamplerState : uint8_t
-	{
-		Point = 0,
-		Linear = 1,
-		Anisotropic = 2,
-		COUNT
-	};
 	enum class CullMode : uint8_t
 	{
 		Back = 0,
@@ -0,0 +1,324 @@
+#include "pch.h"
+#include "JobSystem.h"
+
+namespace dae
+{
+	namespace
+	{
+		// Index of the calling thread in the job system, the creating thread is 0
+		thread_local uint32_t t_ThreadIdx{ UINT32_MAX };
+	}
+
+	bool WorkStealingDeque::Push(Job* pJob) noexcept
+	{
+		int64_t const bottom{ m_Bottom.load(std::memory_order_relaxed) };
+		if (bottom - m_Top.load(std::memory_order_acquire) >= CAPACITY)
+		{
+			return false;
+		}
+
+		m_Jobs[bottom & MASK].store(pJob, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	Job* WorkStealingDeque::Pop() noexcept
+	{
+		int64_t const bottom{ m_Bottom.load(std::memory_order_relaxed) - 1 };
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top{ m_Top.load(std::memory_order_relaxed) };
+
+		if (top > bottom)
+		{
+			// Empty
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* pJob{ m_Jobs[bottom & MASK].load(std::memory_order_relaxed) };
+		if (top == bottom)
+		{
+			// Last job, a thief could be taking it at the same time
+			if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				pJob = nullptr;
+			}
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return pJob;
+	}
+
+	Job* WorkStealingDeque::Steal() noexcept
+	{
+		int64_t top{ m_Top.load(std::memory_order_acquire) };
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t const bottom{ m_Bottom.load(std::memory_order_acquire) };
+
+		if (top >= bottom)
+		{
+			return nullptr;
+		}
+
+		Job* const pJob{ m_Jobs[top & MASK].load(std::memory_order_relaxed) };
+		if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return nullptr; // Lost the race against the owner or another thief
+		}
+		return pJob;
+	}
+
+	JobSystem::JobSystem(uint32_t numWorkers)
+	{
+		assert(t_ThreadIdx == UINT32_MAX && "Only one job system per thread");
+		t_ThreadIdx = 0;
+
+		for (uint32_t i{ 0 }; i < numWorkers + 1; ++i)
+		{
+			m_Queues.emplace_back(std::make_unique<ThreadData>());
+		}
+
+		for (uint32_t i{ 1 }; i < numWorkers + 1; ++i)
+		{
+			m_Workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+
+#if defined(_WIN32)
+			// One core per worker, the creating thread is left to the OS
+			SetThreadAffinityMask(m_Workers.back().native_handle(), DWORD_PTR{ 1 } << (i % (sizeof(DWORD_PTR) * 8)));
+#endif
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		m_IsRunning = false;
+		m_WakeCondition.notify_all();
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+		t_ThreadIdx = UINT32_MAX;
+	}
+
+	Job* JobSystem::CreateJob(std::function<void()> function, Job* pParent)
+	{
+		uint32_t const threadIdx{ GetThreadIdx() };
+		ThreadData& thread{ *m_Queues[threadIdx] };
+
+		// Skip jobs that are still going when the ring wraps around onto them, overwriting one would lose it
+		Job* pJob{ &thread.pJobs[thread.nextJob++ % MAX_JOBS_PER_THREAD] };
+		for (uint32_t numSkipped{ 1 }; pJob->unfinished.load(std::memory_order_acquire) > 0; ++numSkipped)
+		{
+			if (numSkipped % MAX_JOBS_PER_THREAD == 0)
+			{
+				// Every job is in use, help out until one finished
+				if (Job* const pOther{ GetJob(threadIdx) })
+				{
+					Execute(pOther);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			pJob = &thread.pJobs[thread.nextJob++ % MAX_JOBS_PER_THREAD];
+		}
+
+		pJob->function = std::move(function);
+		pJob->pParent = pParent;
+		pJob->unfinished.store(1, std::memory_order_relaxed);
+		pJob->pending.store(1, std::memory_order_relaxed);
+		pJob->numContinuations.store(0, std::memory_order_relaxed);
+
+		if (pParent)
+		{
+			pParent->unfinished.fetch_add(1, std::memory_order_relaxed);
+		}
+		return pJob;
+	}
+
+	Job* JobSystem::CreateParallelFor(size_t count, size_t grainSize, std::function<void(size_t, size_t)> function, Job* pParent)
+	{
+		grainSize = std::max(grainSize, size_t{ 1 });
+
+		// The chunks are only created once the job runs, so it can wait on dependencies like any other job
+		Job* const pRoot{ CreateJob({}, pParent) };
+		pRoot->function = [this, pRoot, count, grainSize, function = std::move(function)]()
+			{
+				for (size_t first{ 0 }; first < count; first += grainSize)
+				{
+					size_t const last{ std::min(first + grainSize, count) };
+					Run(CreateJob([&function, first, last]() { function(first, last); }, pRoot));
+				}
+			};
+		return pRoot;
+	}
+
+	void JobSystem::AddContinuation(Job* pJob, Job* pContinuation) noexcept
+	{
+		// Add the dependency first, so the continuation can't start before pJob finished
+		pContinuation->pending.fetch_add(1, std::memory_order_relaxed);
+
+		uint32_t idx{ pJob->numContinuations.load(std::memory_order_acquire) };
+		do
+		{
+			if (idx == Job::CONTINUATIONS_CLOSED)
+			{
+				// pJob already finished, there is nothing to wait on
+				Run(pContinuation);
+				return;
+			}
+			assert(idx < Job::MAX_CONTINUATIONS && "Too many continuations");
+		} while (!pJob->numContinuations.compare_exchange_weak(idx, idx + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+
+		pJob->pContinuations[idx].store(pContinuation, std::memory_order_release);
+	}
+
+	void JobSystem::Run(Job* pJob)
+	{
+		if (pJob->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			Push(pJob);
+		}
+	}
+
+	void JobSystem::Wait(Job const* pJob)
+	{
+		uint32_t const threadIdx{ GetThreadIdx() };
+		while (pJob->unfinished.load(std::memory_order_acquire) > 0)
+		{
+			if (Job* const pOther{ GetJob(threadIdx) })
+			{
+				Execute(pOther);
+				continue;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::ParallelFor(size_t count, size_t grainSize, std::function<void(size_t, size_t)> function)
+	{
+		Job* const pJob{ CreateParallelFor(count, grainSize, std::move(function)) };
+		Run(pJob);
+		Wait(pJob);
+	}
+
+	uint32_t JobSystem::GetThreadIdx() const noexcept
+	{
+		assert(t_ThreadIdx < m_Queues.size() && "Thread is not part of the job system");
+		return t_ThreadIdx;
+	}
+
+	Job* JobSystem::GetJob(uint32_t threadIdx) noexcept
+	{
+		if (Job* const pJob{ m_Queues[threadIdx]->queue.Pop() })
+		{
+			return pJob;
+		}
+
+		// Own deque is empty, try the others, starting at the next thread so not everyone hammers the same deque
+		auto const numThreads{ static_cast<uint32_t>(m_Queues.size()) };
+		for (uint32_t i{ 1 }; i < numThreads; ++i)
+		{
+			if (Job* const pJob{ m_Queues[(threadIdx + i) % numThreads]->queue.Steal() })
+			{
+				return pJob;
+			}
+		}
+		return nullptr;
+	}
+
+	void JobSystem::Execute(Job* pJob)
+	{
+		if (pJob->function)
+		{
+			pJob->function();
+		}
+		Finish(pJob);
+	}
+
+	void JobSystem::Finish(Job* pJob)
+	{
+		// Only the last one to finish (the job itself or its last child) gets past this, without dropping the count to 0 yet
+		int32_t unfinished{ pJob->unfinished.load(std::memory_order_acquire) };
+		while (unfinished > 1)
+		{
+			if (pJob->unfinished.compare_exchange_weak(unfinished, unfinished - 1, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return; // Children still running, the last one finishes this job
+			}
+		}
+
+		// Nobody can wait past the job yet, so it can't be recycled while it's read.
+		// Closing the continuations makes a later AddContinuation run its continuation right away instead of losing it.
+		Job* const pParent{ pJob->pParent };
+		uint32_t const numContinuations{ pJob->numContinuations.exchange(Job::CONTINUATIONS_CLOSED, std::memory_order_acq_rel) };
+		Job* pContinuations[Job::MAX_CONTINUATIONS];
+		for (uint32_t i{ 0 }; i < numContinuations; ++i)
+		{
+			// AddContinuation counts a continuation before storing it
+			while (!(pContinuations[i] = pJob->pContinuations[i].load(std::memory_order_acquire)))
+			{
+				std::this_thread::yield();
+			}
+			pJob->pContinuations[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		// Done, waiting threads return and the job can be recycled from here on
+		pJob->unfinished.store(0, std::memory_order_release);
+
+		for (uint32_t i{ 0 }; i < numContinuations; ++i)
+		{
+			Run(pContinuations[i]);
+		}
+		if (pParent)
+		{
+			Finish(pParent);
+		}
+	}
+
+	void JobSystem::Push(Job* pJob)
+	{
+		if (!m_Queues[GetThreadIdx()]->queue.Push(pJob))
+		{
+			// Deque is full, the job is ready to go so just run it here
+			Execute(pJob);
+			return;
+		}
+		if (m_NumSleeping.load(std::memory_order_acquire) > 0)
+		{
+			m_WakeCondition.notify_one();
+		}
+	}
+
+	void JobSystem::WorkerLoop(uint32_t threadIdx)
+	{
+		t_ThreadIdx = threadIdx;
+
+		// Spin for a while before going to sleep, a frame hands out new work every few milliseconds
+		uint32_t constexpr SPIN_COUNT{ 1000 };
+		uint32_t idleCount{ 0 };
+		while (m_IsRunning.load(std::memory_order_relaxed))
+		{
+			if (Job* const pJob{ GetJob(threadIdx) })
+			{
+				Execute(pJob);
+				idleCount = 0;
+				continue;
+			}
+
+			if (++idleCount < SPIN_COUNT)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			// The timeout covers a wake up that is sent right before this thread starts waiting
+			std::unique_lock lock{ m_SleepMutex };
+			m_NumSleeping.fetch_add(1, std::memory_order_acq_rel);
+			m_WakeCondition.wait_for(lock, std::chrono::milliseconds{ 1 });
+			m_NumSleeping.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+}
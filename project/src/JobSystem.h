@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class JobSystem;
+
+	// A unit of work. Jobs are owned by the job system and recycled, only hold on to them until they finished.
+	struct Job final
+	{
+		static constexpr uint32_t MAX_CONTINUATIONS{ 8 };
+		static constexpr uint32_t CONTINUATIONS_CLOSED{ UINT32_MAX }; // numContinuations once the job finished
+
+		std::function<void()> function{};
+		Job* pParent{ nullptr };
+		std::atomic<int32_t> unfinished{}; // The job itself + its unfinished children
+		std::atomic<int32_t> pending{}; // Run + unfinished dependencies, the job is pushed once this reaches 0
+
+		std::atomic<Job*> pContinuations[MAX_CONTINUATIONS]{}; // Jobs that depend on this one
+		std::atomic<uint32_t> numContinuations{};
+	};
+
+	// Chase-Lev work stealing deque ("Correct and Efficient Work-Stealing for Weak Memory Models", Lê et al.).
+	// Only the owning thread pushes and pops (at the bottom, LIFO), every other thread steals from the top (FIFO).
+	class WorkStealingDeque final
+	{
+	public:
+		static constexpr int64_t CAPACITY{ 4096 };
+
+		// Returns false when the deque is full
+		[[nodiscard]] bool Push(Job* pJob) noexcept;
+		[[nodiscard]] Job* Pop() noexcept;
+		[[nodiscard]] Job* Steal() noexcept;
+
+	private:
+		static constexpr int64_t MASK{ CAPACITY - 1 };
+		static_assert((CAPACITY & MASK) == 0, "Capacity has to be a power of two");
+
+		std::atomic<int64_t> m_Top{ 0 };
+		std::atomic<int64_t> m_Bottom{ 0 };
+		std::atomic<Job*> m_Jobs[CAPACITY]{};
+	};
+
+	// Persistent pool of worker threads, each with its own deque. Idle threads steal from the others.
+	// The thread that creates the job system takes part as well: it executes jobs while it waits on one.
+	class JobSystem final
+	{
+	public:
+		// numWorkers does not include the creating thread
+		explicit JobSystem(uint32_t numWorkers = std::max(std::thread::hardware_concurrency(), 2u) - 1);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem(JobSystem&&) noexcept = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+		JobSystem& operator=(JobSystem&&) noexcept = delete;
+
+		// The job is not scheduled until Run is called, a parent only finishes after all of its children finished
+		[[nodiscard]] Job* CreateJob(std::function<void()> function, Job* pParent = nullptr);
+		// Splits [0, count) in chunks of grainSize, function(first, last) is called once per chunk.
+		// The returned job finishes once every chunk finished, it is not scheduled until Run is called.
+		[[nodiscard]] Job* CreateParallelFor(size_t count, size_t grainSize, std::function<void(size_t, size_t)> function, Job* pParent = nullptr);
+
+		// pContinuation only starts once pJob finished, call this before pContinuation is Run
+		void AddContinuation(Job* pJob, Job* pContinuation) noexcept;
+
+		// Schedules the job, it starts as soon as all of its dependencies finished
+		void Run(Job* pJob);
+		// Executes other jobs on this thread until the job (and all of its children) finished
+		void Wait(Job const* pJob);
+
+		// Run + Wait
+		void ParallelFor(size_t count, size_t grainSize, std::function<void(size_t, size_t)> function);
+
+		[[nodiscard]] uint32_t GetNumThreads() const noexcept
+		{
+			return static_cast<uint32_t>(m_Queues.size());
+		}
+
+	private:
+		// Jobs are recycled in a ring per thread, unfinished jobs are skipped. When all of them are unfinished, CreateJob runs other jobs until one is free.
+		static constexpr uint32_t MAX_JOBS_PER_THREAD{ 4096 };
+
+		struct ThreadData
+		{
+			WorkStealingDeque queue{};
+			std::unique_ptr<Job[]> pJobs{ std::make_unique<Job[]>(MAX_JOBS_PER_THREAD) };
+			uint32_t nextJob{ 0 };
+		};
+
+		std::vector<std::unique_ptr<ThreadData>> m_Queues{}; // Index 0 is the thread that created the job system
+		std::vector<std::thread> m_Workers{};
+
+		std::atomic<bool> m_IsRunning{ true };
+		std::atomic<uint32_t> m_NumSleeping{ 0 };
+		std::mutex m_SleepMutex{};
+		std::condition_variable m_WakeCondition{};
+
+		[[nodiscard]] uint32_t GetThreadIdx() const noexcept;
+		[[nodiscard]] Job* GetJob(uint32_t threadIdx) noexcept;
+		void Execute(Job* pJob);
+		void Finish(Job* pJob);
+		void Push(Job* pJob);
+		void WorkerLoop(uint32_t threadIdx);
+	};
+}
@@ -8,6 +8,42 @@ dae::Mesh::Mesh(ID3D11Device* pDevice, std::string const& path, std::shared_ptr<
 	m_Indices = {};
 	Utils::ParseOBJ(path, m_Vertices, m_Indices);
 
+	//Optimize the buffers for the post-transform vertex cache and overdraw, both rasterizers draw the same index buffer.
+	//OBJ files always give triangle lists, everything below relies on that.
+	MeshOptimizer::WeldVertices(m_Vertices, m_Indices);
+	float const acmrBefore{ MeshOptimizer::CalculateACMR(m_Indices, m_Vertices.size()) };
+	MeshOptimizer::OptimizeVertexCache(m_Indices, m_Vertices.size());
+	MeshOptimizer::OptimizeOverdraw(m_Indices, m_Vertices);
+
+	//Meshlets for culling, these reorder the triangles again so the vertex order can only be decided afterwards
+	MeshOptimizer::BuildMeshlets(m_Indices, m_Vertices, m_Meshlets);
+	MeshOptimizer::OptimizeVertexFetch(m_Vertices, m_Indices);
+	MeshOptimizer::BuildMeshletVertices(m_Indices, m_Vertices.size(), m_Meshlets, m_MeshletVertices);
+	m_VisibleMeshlets.reserve(m_Meshlets.size());
+
+	float const acmrAfter{ MeshOptimizer::CalculateACMR(m_Indices, m_Vertices.size()) };
+	std::cout << path << " -> " << m_Vertices.size() << " vertices, " << m_Meshlets.size() << " meshlets, ACMR " << acmrBefore << " -> " << GREEN << acmrAfter << "\n" << RESET;
+
+	//Bounds of the whole mesh, the sphere is centered on the box (not the tightest sphere, but close enough for culling)
+	Vector3 minimum{ FLT_MAX, FLT_MAX, FLT_MAX };
+	Vector3 maximum{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (Vertex_In const& v : m_Vertices)
+	{
+		for (int axis{ 0 }; axis < 3; ++axis)
+		{
+			minimum[axis] = std::min(minimum[axis], v.position[axis]);
+			maximum[axis] = std::max(maximum[axis], v.position[axis]);
+		}
+	}
+	m_BoundingBox = { (minimum + maximum) * 0.5f, (maximum - minimum) * 0.5f };
+	m_BoundingSphere.center = m_BoundingBox.center;
+	for (Vertex_In const& v : m_Vertices)
+	{
+		m_BoundingSphere.radius = std::max(m_BoundingSphere.radius, (v.position - m_BoundingSphere.center).Magnitude());
+	}
+
+	m_VertexInput = VertexInputStream{ m_Vertices };
+
 	m_pEffect = pEffect;
 	assert(m_pEffect);
 
@@ -79,3 +115,28 @@ dae::Mesh::Mesh(ID3D11Device* pDevice, std::string const& path, std::shared_ptr<
 	if (FAILED(hr))
 		assert(false && "Failed to create index buffer");
 }
+
+void dae::Mesh::CullMeshlets(Matrix const& viewProjectionMatrix, Vector3 const& cameraPos, CullMode cullMode)
+{
+	//Cull in model space, so the bounds don't have to be transformed
+	Frustum const frustum{ m_WorldMatrix * viewProjectionMatrix };
+	Vector3 const modelCameraPos{ Matrix::Inverse(m_WorldMatrix).TransformPoint(cameraPos) };
+
+	m_VisibleMeshlets.clear();
+	for (uint32_t i{ 0 }; i < m_Meshlets.size(); ++i)
+	{
+		Meshlet const& meshlet{ m_Meshlets[i] };
+		if (frustum.IsSphereOutside(meshlet.center, meshlet.radius))
+		{
+			continue;
+		}
+
+		//Front face culling is the same test with the cone flipped around
+		if ((cullMode == CullMode::Back && IsConeBackFacing(meshlet.center, meshlet.radius, meshlet.coneAxis, meshlet.coneCutoff, modelCameraPos))
+			|| (cullMode == CullMode::Front && IsConeBackFacing(meshlet.center, meshlet.radius, -meshlet.coneAxis, meshlet.coneCutoff, modelCameraPos)))
+		{
+			continue;
+		}
+		m_VisibleMeshlets.push_back(i);
+	}
+}
@@ -2,6 +2,9 @@
 #include "Effect.h"
 #include "Matrix.h"
 #include "Vertex_In.h"
+#include "VertexStream.h"
+#include "MeshOptimizer.h"
+#include "Culling.h"
 #include "Texture.h"
 
 
@@ -47,16 +50,28 @@ namespace dae
 			//Set index buffer
 			pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
-			//Draw
+			//Draw the meshlets that survived culling, neighbouring meshlets are merged into a single draw call
 			D3DX11_TECHNIQUE_DESC techDesc{};
 			m_pEffect->GetTechnique()->GetDesc(&techDesc);
 			for (UINT p = 0; p < techDesc.Passes; ++p)
 			{
 				m_pEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, pDeviceContext);
-				pDeviceContext->DrawIndexed(static_cast<uint32_t>(m_Indices.size()), 0, 0);
+				for (size_t i{ 0 }; i < m_VisibleMeshlets.size();)
+				{
+					Meshlet const& first{ m_Meshlets[m_VisibleMeshlets[i]] };
+					uint32_t indexCount{ first.indexCount };
+					for (++i; i < m_VisibleMeshlets.size() && m_VisibleMeshlets[i] == m_VisibleMeshlets[i - 1] + 1; ++i)
+					{
+						indexCount += m_Meshlets[m_VisibleMeshlets[i]].indexCount;
+					}
+					pDeviceContext->DrawIndexed(indexCount, first.firstIndex, 0);
+				}
 			}
 		}
 
+		// Frustum and normal cone culling of the meshlets, both rasterizers only draw the visible ones afterwards
+		void CullMeshlets(Matrix const& viewProjectionMatrix, Vector3 const& cameraPos, CullMode cullMode);
+
 		// Position
 		void UpdateCameraPos(Vector3 const& cameraPos)
 		{
@@ -89,13 +104,44 @@ namespace dae
 			return m_Indices;
 		}
 
-		[[nodiscard]] std::vector<Vertex_Out>& GetVertices_Out_Ref() noexcept
+		// Bounds of the whole mesh in world space
+		[[nodiscard]] BoundingSphere GetWorldBoundingSphere() const noexcept
+		{
+			return TransformSphere(m_BoundingSphere, m_WorldMatrix);
+		}
+		[[nodiscard]] BoundingBox GetWorldBoundingBox() const noexcept
+		{
+			return TransformBox(m_BoundingBox, m_WorldMatrix);
+		}
+
+		[[nodiscard]] std::vector<Meshlet> const& GetMeshlets() const noexcept
+		{
+			return m_Meshlets;
+		}
+
+		[[nodiscard]] std::vector<uint32_t> const& GetMeshletVertices() const noexcept
+		{
+			return m_MeshletVertices;
+		}
+
+		// Indices into the meshlets, in increasing order
+		[[nodiscard]] std::vector<uint32_t> const& GetVisibleMeshlets() const noexcept
+		{
+			return m_VisibleMeshlets;
+		}
+
+		[[nodiscard]] VertexInputStream const& GetVertexInput() const noexcept
 		{
-			return m_Vertices_Out;
+			return m_VertexInput;
 		}
-		[[nodiscard]] std::vector<Vertex_Out> const& GetVertices_Out() const noexcept
+
+		[[nodiscard]] VertexOutputStream& GetVertexOutput_Ref() noexcept
+		{
+			return m_VertexOutput;
+		}
+		[[nodiscard]] VertexOutputStream const& GetVertexOutput() const noexcept
 		{
-			return m_Vertices_Out;
+			return m_VertexOutput;
 		}
 
 		[[nodiscard]] std::vector<Vertex_In> const& GetVertices() const noexcept
@@ -131,10 +177,19 @@ namespace dae
 
 		//These don't have to be stored for the hardware rasterizer but are necessare for software.
 		std::vector<Vertex_In> m_Vertices{};
-		std::vector<Vertex_Out> m_Vertices_Out{};
+		VertexInputStream m_VertexInput{};
+		VertexOutputStream m_VertexOutput{};
 		std::vector<uint32_t> m_Indices{};
 		PrimitiveTopology m_PrimitiveTopology{ PrimitiveTopology::TriangleList };
 
+		//Model space bounds
+		BoundingSphere m_BoundingSphere{};
+		BoundingBox m_BoundingBox{};
+
+		std::vector<Meshlet> m_Meshlets{};
+		std::vector<uint32_t> m_MeshletVertices{};
+		std::vector<uint32_t> m_VisibleMeshlets{};
+
 		// would be shared with resource manager
 		std::shared_ptr<BaseEffect> m_pEffect{};
 
@@ -0,0 +1,692 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Vertex_In.h"
+
+namespace dae
+{
+	// Small cluster of triangles that gets culled as a whole.
+	// It covers a contiguous range of the index buffer, so the hardware rasterizer can draw it (and its visible neighbours) with a single DrawIndexed.
+	struct Meshlet
+	{
+		uint32_t firstTriangle{};
+		uint32_t triangleCount{};
+		uint32_t firstIndex{};
+		uint32_t indexCount{};
+		uint32_t firstVertex{}; // Into the meshlet vertex list, the unique vertices the triangles use
+		uint32_t vertexCount{};
+
+		// Bounding sphere, in model space
+		Vector3 center{};
+		float radius{};
+
+		// Normal cone, coneCutoff is 1 when the normals are too spread out to ever cull the meshlet
+		Vector3 coneAxis{};
+		float coneCutoff{ 1.f };
+	};
+
+	// Load time index/vertex buffer optimizations, all of them work on indexed triangle lists
+	namespace MeshOptimizer
+	{
+		// Size of the simulated post-transform cache used for the ACMR
+		uint32_t constexpr ACMR_CACHE_SIZE{ 16 };
+
+		// Same limits as the meshlets of mesh shaders (124 triangles keeps the local triangle indices of a meshlet within 128 * 3 bytes)
+		uint32_t constexpr MESHLET_MAX_VERTICES{ 64 };
+		uint32_t constexpr MESHLET_MAX_TRIANGLES{ 124 };
+		// A triangle only joins a meshlet when its normal is within ~37 degrees of the meshlet's average normal.
+		// Wider cones hardly ever pass the backface test, the vehicle is too low poly for big meshlets with tight cones.
+		float constexpr MESHLET_MIN_NORMAL_DOT{ 0.8f };
+
+		// Merges vertices that are exactly the same (every component), the indices are remapped to the remaining vertices
+		inline void WeldVertices(std::vector<Vertex_In>& vertices, std::vector<uint32_t>& indices)
+		{
+			auto const toBytes = [](Vertex_In const& v) { return std::string_view{ reinterpret_cast<char const*>(&v), sizeof(Vertex_In) }; };
+
+			std::unordered_map<std::string_view, uint32_t> uniqueVertices{};
+			std::vector<uint32_t> remap(vertices.size());
+			std::vector<Vertex_In> welded{};
+			welded.reserve(vertices.size());
+
+			for (size_t i{ 0 }; i < vertices.size(); ++i)
+			{
+				// The keys point into the old vertices, those stay alive until the end of this function
+				auto const [it, isNew] { uniqueVertices.try_emplace(toBytes(vertices[i]), static_cast<uint32_t>(welded.size())) };
+				if (isNew)
+				{
+					welded.push_back(vertices[i]);
+				}
+				remap[i] = it->second;
+			}
+
+			for (uint32_t& index : indices)
+			{
+				index = remap[index];
+			}
+			vertices = std::move(welded);
+		}
+
+		// Simulated FIFO post-transform cache, a vertex is in the cache when it got added less than size misses ago
+		class FifoCache final
+		{
+		public:
+			constexpr FifoCache(size_t vertexCount, uint32_t size = ACMR_CACHE_SIZE) :
+				m_AddedAt(vertexCount, 0),
+				m_Size{ size }
+			{}
+
+			// Returns true on a cache miss (the vertex has to be transformed)
+			constexpr bool Access(uint32_t index) noexcept
+			{
+				if (m_AddedAt[index] != 0 && m_Misses - m_AddedAt[index] < m_Size)
+				{
+					return false;
+				}
+				++m_Misses;
+				m_AddedAt[index] = m_Misses;
+				return true;
+			}
+
+			[[nodiscard]] constexpr uint32_t AccessTriangle(uint32_t const* pIndices) noexcept
+			{
+				return Access(pIndices[0]) + Access(pIndices[1]) + Access(pIndices[2]);
+			}
+
+			// Empties the cache, entries added before this are all considered evicted
+			constexpr void Flush() noexcept
+			{
+				m_Misses += m_Size;
+			}
+
+			[[nodiscard]] constexpr uint32_t GetMisses() const noexcept
+			{
+				return m_Misses;
+			}
+
+		private:
+			std::vector<uint32_t> m_AddedAt;
+			uint32_t m_Size;
+			uint32_t m_Misses{ 0 };
+		};
+
+		// Hand traced: vertex 0 is still cached after 15 other misses, the 16th evicts it
+		static_assert([]
+			{
+				FifoCache cache{ 32, 16 };
+				cache.Access(0);
+				for (uint32_t i{ 1 }; i <= 15; ++i)
+				{
+					cache.Access(i);
+				}
+				bool const isHit{ !cache.Access(0) };
+
+				FifoCache evicted{ 32, 16 };
+				evicted.Access(0);
+				for (uint32_t i{ 1 }; i <= 16; ++i)
+				{
+					evicted.Access(i);
+				}
+				return isHit && evicted.Access(0);
+			}(), "A FifoCache of size n has to hold n vertices");
+
+		// Average cache miss ratio: transformed vertices per triangle, 0.5 is the best case for big meshes, 3 the worst
+		[[nodiscard]] inline float CalculateACMR(std::vector<uint32_t> const& indices, size_t vertexCount)
+		{
+			if (indices.size() < 3)
+			{
+				return 0.f;
+			}
+
+			FifoCache cache{ vertexCount };
+			for (uint32_t const index : indices)
+			{
+				cache.Access(index);
+			}
+			return static_cast<float>(cache.GetMisses()) / static_cast<float>(indices.size() / 3);
+		}
+
+		// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily picks the next triangle with the highest score,
+		// vertices score higher when they are recently used (in the simulated LRU cache) and when they have few triangles left.
+		inline void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+		{
+			int constexpr CACHE_SIZE{ 32 };
+			float constexpr CACHE_DECAY_POWER{ 1.5f };
+			float constexpr LAST_TRIANGLE_SCORE{ 0.75f };
+			float constexpr VALENCE_BOOST_SCALE{ 2.f };
+			float constexpr VALENCE_BOOST_POWER{ 0.5f };
+
+			size_t const triangleCount{ indices.size() / 3 };
+			if (triangleCount == 0)
+			{
+				return;
+			}
+
+			auto const calculateVertexScore = [&](int cachePosition, uint32_t remainingTriangles) -> float
+				{
+					if (remainingTriangles == 0)
+					{
+						return -1.f; // Not used anymore
+					}
+
+					float score{ 0.f };
+					if (cachePosition >= 0)
+					{
+						// The last triangle's vertices get a fixed score, so the next triangle doesn't always just reuse two of them
+						if (cachePosition < 3)
+						{
+							score = LAST_TRIANGLE_SCORE;
+						}
+						else
+						{
+							float const scaler{ 1.f / (CACHE_SIZE - 3) };
+							score = std::pow(1.f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+						}
+					}
+
+					// Boost vertices with few triangles left, so they are finished off and stop wasting cache space
+					score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+					return score;
+				};
+
+			// Triangles per vertex, as one flat array
+			std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+			for (uint32_t const index : indices)
+			{
+				++triangleOffsets[index + 1];
+			}
+			for (size_t v{ 0 }; v < vertexCount; ++v)
+			{
+				triangleOffsets[v + 1] += triangleOffsets[v];
+			}
+			std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+			std::vector<uint32_t> vertexTriangles(indices.size());
+			for (uint32_t t{ 0 }; t < triangleCount; ++t)
+			{
+				for (int c{ 0 }; c < 3; ++c)
+				{
+					uint32_t const v{ indices[t * 3 + c] };
+					vertexTriangles[triangleOffsets[v] + remainingTriangles[v]++] = t;
+				}
+			}
+
+			std::vector<int> cachePositions(vertexCount, -1);
+			std::vector<float> vertexScores(vertexCount);
+			for (size_t v{ 0 }; v < vertexCount; ++v)
+			{
+				vertexScores[v] = calculateVertexScore(-1, remainingTriangles[v]);
+			}
+
+			std::vector<float> triangleScores(triangleCount);
+			std::vector<bool> isEmitted(triangleCount, false);
+			for (size_t t{ 0 }; t < triangleCount; ++t)
+			{
+				triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+			}
+
+			// Removes an emitted triangle from the per vertex lists, called once per corner.
+			// Degenerate triangles are in a vertex's list once per corner using it, so they are removed just as often.
+			auto const removeTriangle = [&](uint32_t v, uint32_t t)
+				{
+					uint32_t* const pBegin{ &vertexTriangles[triangleOffsets[v]] };
+					uint32_t* const pEnd{ pBegin + remainingTriangles[v] };
+					uint32_t* const pFound{ std::find(pBegin, pEnd, t) };
+					assert(pFound != pEnd && "Triangle is not in the vertex's list");
+					std::iter_swap(pFound, pEnd - 1);
+					--remainingTriangles[v];
+				};
+
+			std::vector<uint32_t> optimized{};
+			optimized.reserve(indices.size());
+			std::vector<uint32_t> cache{};
+			cache.reserve(CACHE_SIZE + 3);
+
+			size_t nextFallback{ 0 };
+			int64_t bestTriangle{ -1 };
+			for (size_t emitted{ 0 }; emitted < triangleCount; ++emitted)
+			{
+				// Nothing in the cache is connected to a triangle anymore, start over with the best remaining one
+				if (bestTriangle < 0)
+				{
+					float bestScore{ -1.f };
+					for (size_t t{ nextFallback }; t < triangleCount; ++t)
+					{
+						if (!isEmitted[t] && triangleScores[t] > bestScore)
+						{
+							bestScore = triangleScores[t];
+							bestTriangle = static_cast<int64_t>(t);
+						}
+					}
+					while (nextFallback < triangleCount && isEmitted[nextFallback])
+					{
+						++nextFallback;
+					}
+				}
+
+				auto const t{ static_cast<uint32_t>(bestTriangle) };
+				isEmitted[t] = true;
+
+				// Emit, then move the triangle's vertices to the front of the cache
+				uint32_t const triangleVertices[3]{ indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+				std::vector<uint32_t> newCache{ triangleVertices, triangleVertices + 3 };
+				for (uint32_t const v : triangleVertices)
+				{
+					optimized.push_back(v);
+					removeTriangle(v, t);
+				}
+				for (uint32_t const v : cache)
+				{
+					if (v != triangleVertices[0] && v != triangleVertices[1] && v != triangleVertices[2])
+					{
+						newCache.push_back(v);
+					}
+				}
+
+				// Update the scores of everything that was in the cache, vertices falling out of it get their position reset
+				for (size_t i{ 0 }; i < newCache.size(); ++i)
+				{
+					uint32_t const v{ newCache[i] };
+					cachePositions[v] = i < CACHE_SIZE ? static_cast<int>(i) : -1;
+					vertexScores[v] = calculateVertexScore(cachePositions[v], remainingTriangles[v]);
+				}
+
+				// Only triangles touching the cache changed their score, the best one of those is emitted next
+				bestTriangle = -1;
+				float bestScore{ -1.f };
+				for (uint32_t const v : newCache)
+				{
+					for (uint32_t i{ 0 }; i < remainingTriangles[v]; ++i)
+					{
+						uint32_t const other{ vertexTriangles[triangleOffsets[v] + i] };
+						float const score{ vertexScores[indices[other * 3]] + vertexScores[indices[other * 3 + 1]] + vertexScores[indices[other * 3 + 2]] };
+						triangleScores[other] = score;
+						if (score > bestScore)
+						{
+							bestScore = score;
+							bestTriangle = other;
+						}
+					}
+				}
+
+				if (newCache.size() > CACHE_SIZE)
+				{
+					newCache.resize(CACHE_SIZE);
+				}
+				cache = std::move(newCache);
+			}
+
+			indices = std::move(optimized);
+		}
+
+		// Reorders the vertices in the order the index buffer first uses them, so vertex fetches mostly walk forward through memory.
+		// Vertices that are never used are dropped.
+		inline void OptimizeVertexFetch(std::vector<Vertex_In>& vertices, std::vector<uint32_t>& indices)
+		{
+			uint32_t constexpr UNUSED{ UINT32_MAX };
+			std::vector<uint32_t> remap(vertices.size(), UNUSED);
+			std::vector<Vertex_In> reordered{};
+			reordered.reserve(vertices.size());
+
+			for (uint32_t& index : indices)
+			{
+				if (remap[index] == UNUSED)
+				{
+					remap[index] = static_cast<uint32_t>(reordered.size());
+					reordered.push_back(vertices[index]);
+				}
+				index = remap[index];
+			}
+			vertices = std::move(reordered);
+		}
+
+		// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", the way meshoptimizer does it.
+		// Splits the (vertex cache optimized) triangles into clusters and puts clusters that face away from the center of the mesh first,
+		// those are the most likely to be in front of the rest from any view direction so fewer fragments get shaded and then overwritten.
+		// threshold is how much worse the ACMR is allowed to get, smaller clusters sort better but break up more of the cache order.
+		inline void OptimizeOverdraw(std::vector<uint32_t>& indices, std::vector<Vertex_In> const& vertices, float threshold = 1.05f)
+		{
+			size_t const triangleCount{ indices.size() / 3 };
+			if (triangleCount == 0)
+			{
+				return;
+			}
+
+			// Hard boundaries: triangles that share no vertex with the cache, the cache order is already broken there
+			std::vector<size_t> hardClusters{};
+			{
+				FifoCache cache{ vertices.size() };
+				for (size_t t{ 0 }; t < triangleCount; ++t)
+				{
+					if (cache.AccessTriangle(&indices[t * 3]) == 3 || t == 0)
+					{
+						hardClusters.push_back(t);
+					}
+				}
+				hardClusters.push_back(triangleCount);
+			}
+
+			// Soft boundaries: split the hard clusters further as soon as the part so far reaches the cluster's ACMR (times the threshold)
+			std::vector<size_t> clusters{};
+			{
+				FifoCache cache{ vertices.size() };
+				for (size_t c{ 0 }; c + 1 < hardClusters.size(); ++c)
+				{
+					size_t const start{ hardClusters[c] };
+					size_t const end{ hardClusters[c + 1] };
+
+					cache.Flush();
+					uint32_t const missesBefore{ cache.GetMisses() };
+					for (size_t t{ start }; t < end; ++t)
+					{
+						static_cast<void>(cache.AccessTriangle(&indices[t * 3]));
+					}
+					float const clusterThreshold{ threshold * static_cast<float>(cache.GetMisses() - missesBefore) / static_cast<float>(end - start) };
+
+					clusters.push_back(start);
+					cache.Flush();
+					uint32_t runningMisses{ 0 };
+					uint32_t runningTriangles{ 0 };
+					for (size_t t{ start }; t + 1 < end; ++t)
+					{
+						runningMisses += cache.AccessTriangle(&indices[t * 3]);
+						++runningTriangles;
+						if (static_cast<float>(runningMisses) / static_cast<float>(runningTriangles) <= clusterThreshold)
+						{
+							clusters.push_back(t + 1);
+							cache.Flush();
+							runningMisses = 0;
+							runningTriangles = 0;
+						}
+					}
+				}
+				clusters.push_back(triangleCount);
+			}
+
+			// Area weighted center of the mesh and of every cluster, the vertex normals give the direction a cluster faces (independent of the winding)
+			auto const getTriangleArea = [&](size_t t)
+				{
+					Vector3 const& p0{ vertices[indices[t * 3]].position };
+					return Vector3::Cross(vertices[indices[t * 3 + 1]].position - p0, vertices[indices[t * 3 + 2]].position - p0).Magnitude() * 0.5f;
+				};
+			auto const getTriangleCenter = [&](size_t t)
+				{
+					return (vertices[indices[t * 3]].position + vertices[indices[t * 3 + 1]].position + vertices[indices[t * 3 + 2]].position) / 3.f;
+				};
+
+			Vector3 meshCenter{};
+			float meshArea{ 0.f };
+			for (size_t t{ 0 }; t < triangleCount; ++t)
+			{
+				float const area{ getTriangleArea(t) };
+				meshCenter += getTriangleCenter(t) * area;
+				meshArea += area;
+			}
+			if (meshArea > 0.f)
+			{
+				meshCenter /= meshArea;
+			}
+
+			size_t const clusterCount{ clusters.size() - 1 };
+			std::vector<float> sortKeys(clusterCount);
+			for (size_t c{ 0 }; c < clusterCount; ++c)
+			{
+				Vector3 center{};
+				Vector3 normal{};
+				float clusterArea{ 0.f };
+				for (size_t t{ clusters[c] }; t < clusters[c + 1]; ++t)
+				{
+					float const area{ getTriangleArea(t) };
+					center += getTriangleCenter(t) * area;
+					normal += (vertices[indices[t * 3]].normal + vertices[indices[t * 3 + 1]].normal + vertices[indices[t * 3 + 2]].normal) * area;
+					clusterArea += area;
+				}
+				if (clusterArea > 0.f)
+				{
+					center /= clusterArea;
+				}
+				if (normal.SqrMagnitude() > 0.f)
+				{
+					normal.Normalize();
+				}
+
+				// How far out the cluster sits along the direction it faces
+				sortKeys[c] = Vector3::Dot(center - meshCenter, normal);
+			}
+
+			std::vector<size_t> clusterOrder(clusterCount);
+			for (size_t c{ 0 }; c < clusterCount; ++c)
+			{
+				clusterOrder[c] = c;
+			}
+			std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			std::vector<uint32_t> sorted{};
+			sorted.reserve(indices.size());
+			for (size_t const c : clusterOrder)
+			{
+				sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+			}
+			indices = std::move(sorted);
+		}
+
+		// Groups the triangles into meshlets and rewrites the index buffer in meshlet order, so every meshlet is a contiguous range of it.
+		// A meshlet starts at the first remaining triangle (keeping the overdraw order mostly intact) and grows with neighbouring triangles
+		// that add few vertices and face the same way, a tight normal cone is what makes backface culling of the whole meshlet possible.
+		// Only sets the triangle ranges and the bounds, BuildMeshletVertices fills in the vertices once the vertex order is final.
+		inline void BuildMeshlets(std::vector<uint32_t>& indices, std::vector<Vertex_In> const& vertices, std::vector<Meshlet>& meshlets)
+		{
+			meshlets.clear();
+			auto const triangleCount{ static_cast<uint32_t>(indices.size() / 3) };
+			if (triangleCount == 0)
+			{
+				return;
+			}
+
+			std::vector<Vector3> triangleNormals(triangleCount);
+			for (uint32_t t{ 0 }; t < triangleCount; ++t)
+			{
+				Vector3 const& p0{ vertices[indices[t * 3]].position };
+				Vector3 const normal{ Vector3::Cross(vertices[indices[t * 3 + 1]].position - p0, vertices[indices[t * 3 + 2]].position - p0) };
+				triangleNormals[t] = normal.SqrMagnitude() > 0.f ? normal.Normalized() : Vector3{};
+			}
+
+			// Neighbours are found through the positions, vertices split by uv seams or hard edges still connect their triangles
+			std::vector<uint32_t> positionIds(vertices.size());
+			{
+				auto const toBytes = [](Vector3 const& p) { return std::string_view{ reinterpret_cast<char const*>(&p), sizeof(Vector3) }; };
+				std::unordered_map<std::string_view, uint32_t> uniquePositions{};
+				for (size_t v{ 0 }; v < vertices.size(); ++v)
+				{
+					positionIds[v] = uniquePositions.try_emplace(toBytes(vertices[v].position), static_cast<uint32_t>(uniquePositions.size())).first->second;
+				}
+			}
+
+			// Triangles per position, as one flat array
+			std::vector<uint32_t> triangleOffsets(vertices.size() + 1, 0);
+			for (uint32_t const index : indices)
+			{
+				++triangleOffsets[positionIds[index] + 1];
+			}
+			for (size_t p{ 0 }; p < vertices.size(); ++p)
+			{
+				triangleOffsets[p + 1] += triangleOffsets[p];
+			}
+			std::vector<uint32_t> positionTriangles(indices.size());
+			{
+				std::vector<uint32_t> fill{ triangleOffsets.begin(), triangleOffsets.end() - 1 };
+				for (uint32_t t{ 0 }; t < triangleCount; ++t)
+				{
+					for (int c{ 0 }; c < 3; ++c)
+					{
+						positionTriangles[fill[positionIds[indices[t * 3 + c]]]++] = t;
+					}
+				}
+			}
+
+			std::vector<bool> isEmitted(triangleCount, false);
+			std::vector<uint32_t> vertexMeshlet(vertices.size(), UINT32_MAX); // Last meshlet that uses the vertex
+			std::vector<uint32_t> meshletVertices{};
+			std::vector<uint32_t> sorted{};
+			sorted.reserve(indices.size());
+
+			auto const countNewVertices = [&](uint32_t t, uint32_t meshletIdx)
+				{
+					uint32_t const* const pTriangle{ &indices[t * 3] };
+					uint32_t newVertices{ 0 };
+					for (int c{ 0 }; c < 3; ++c)
+					{
+						bool const isDuplicate{ (c > 0 && pTriangle[c] == pTriangle[0]) || (c > 1 && pTriangle[c] == pTriangle[1]) };
+						newVertices += vertexMeshlet[pTriangle[c]] != meshletIdx && !isDuplicate;
+					}
+					return newVertices;
+				};
+
+			uint32_t nextSeed{ 0 };
+			while (sorted.size() < indices.size())
+			{
+				while (isEmitted[nextSeed])
+				{
+					++nextSeed;
+				}
+
+				auto const meshletIdx{ static_cast<uint32_t>(meshlets.size()) };
+				Meshlet meshlet{};
+				meshlet.firstTriangle = static_cast<uint32_t>(sorted.size() / 3);
+				meshlet.firstIndex = static_cast<uint32_t>(sorted.size());
+				meshletVertices.clear();
+				Vector3 normalSum{};
+
+				int64_t next{ nextSeed };
+				while (next >= 0)
+				{
+					auto const t{ static_cast<uint32_t>(next) };
+					isEmitted[t] = true;
+					for (int c{ 0 }; c < 3; ++c)
+					{
+						uint32_t const v{ indices[t * 3 + c] };
+						sorted.push_back(v);
+						if (vertexMeshlet[v] != meshletIdx)
+						{
+							vertexMeshlet[v] = meshletIdx;
+							meshletVertices.push_back(v);
+						}
+					}
+					++meshlet.triangleCount;
+					normalSum += triangleNormals[t];
+
+					if (meshlet.triangleCount == MESHLET_MAX_TRIANGLES)
+					{
+						break;
+					}
+
+					// Best neighbour: the fewest extra vertices, then the normal closest to the meshlet's average
+					Vector3 const axis{ normalSum.SqrMagnitude() > 0.f ? normalSum.Normalized() : Vector3{} };
+					next = -1;
+					float bestScore{ FLT_MAX };
+					for (uint32_t const v : meshletVertices)
+					{
+						uint32_t const p{ positionIds[v] };
+						for (uint32_t i{ triangleOffsets[p] }; i < triangleOffsets[p + 1]; ++i)
+						{
+							uint32_t const candidate{ positionTriangles[i] };
+							if (isEmitted[candidate])
+							{
+								continue;
+							}
+
+							uint32_t const newVertices{ countNewVertices(candidate, meshletIdx) };
+							if (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES)
+							{
+								continue;
+							}
+
+							float const normalDot{ Vector3::Dot(triangleNormals[candidate], axis) };
+							if (normalDot < MESHLET_MIN_NORMAL_DOT)
+							{
+								continue;
+							}
+
+							float const score{ static_cast<float>(newVertices) + (1.f - normalDot) };
+							if (score < bestScore)
+							{
+								bestScore = score;
+								next = candidate;
+							}
+						}
+					}
+				}
+
+				meshlet.indexCount = meshlet.triangleCount * 3;
+				meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+				// Bounding sphere around the vertices
+				Vector3 minimum{ FLT_MAX, FLT_MAX, FLT_MAX };
+				Vector3 maximum{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				for (uint32_t const v : meshletVertices)
+				{
+					for (int axis{ 0 }; axis < 3; ++axis)
+					{
+						minimum[axis] = std::min(minimum[axis], vertices[v].position[axis]);
+						maximum[axis] = std::max(maximum[axis], vertices[v].position[axis]);
+					}
+				}
+				meshlet.center = (minimum + maximum) * 0.5f;
+				for (uint32_t const v : meshletVertices)
+				{
+					meshlet.radius = std::max(meshlet.radius, (vertices[v].position - meshlet.center).Magnitude());
+				}
+
+				// Cone around the geometric normals, normals spread over (almost) a half sphere can never all face away from the camera
+				if (normalSum.SqrMagnitude() > 0.f)
+				{
+					meshlet.coneAxis = normalSum.Normalized();
+					float minDot{ 1.f };
+					for (uint32_t i{ meshlet.firstIndex }; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+					{
+						Vector3 const& p0{ vertices[sorted[i]].position };
+						Vector3 const normal{ Vector3::Cross(vertices[sorted[i + 1]].position - p0, vertices[sorted[i + 2]].position - p0) };
+						if (normal.SqrMagnitude() > 0.f)
+						{
+							minDot = std::min(minDot, Vector3::Dot(normal.Normalized(), meshlet.coneAxis));
+						}
+					}
+					if (minDot > 0.1f)
+					{
+						// Sine of the cone's half angle, the view direction has to be within 90 degrees minus that angle of the axis
+						meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+					}
+				}
+
+				meshlets.push_back(meshlet);
+			}
+
+			indices = std::move(sorted);
+		}
+
+		// The unique vertices of every meshlet, Meshlet::firstVertex points into meshletVertices
+		inline void BuildMeshletVertices(std::vector<uint32_t> const& indices, size_t vertexCount, std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices)
+		{
+			meshletVertices.clear();
+			std::vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX);
+			for (uint32_t m{ 0 }; m < meshlets.size(); ++m)
+			{
+				Meshlet& meshlet{ meshlets[m] };
+				meshlet.firstVertex = static_cast<uint32_t>(meshletVertices.size());
+				for (uint32_t i{ meshlet.firstIndex }; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+				{
+					if (vertexMeshlet[indices[i]] != m)
+					{
+						vertexMeshlet[indices[i]] = m;
+						meshletVertices.push_back(indices[i]);
+					}
+				}
+				meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size()) - meshlet.firstVertex;
+			}
+		}
+	}
+}
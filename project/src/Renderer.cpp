@@ -4,7 +4,10 @@
 #include "Utils.h"
 #include "BRDF.h"
 #include "Effect.h"
-#include <execution>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <tuple>
 
 namespace dae {
 
@@ -18,10 +21,52 @@ namespace dae {
 		m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
 		m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
 		m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
+		m_pUpscaleBuffer = SDL_CreateRGBSurfaceWithFormat(0, m_Width, m_Height, 32, m_pBackBuffer->format->format);
+		m_RenderWidth = m_Width;
+		m_RenderHeight = m_Height;
 
 		m_pDepthBufferPixels = new float[m_Width * m_Height];
 		std::fill_n(m_pDepthBufferPixels, (m_Width * m_Height), FLT_MAX);
 
+		m_pVisibilityBuffer = new VisibilityTexel[m_Width * m_Height];
+		m_pDepthOwners = new uint32_t[m_Width * m_Height];
+
+		m_HiZWidth = (m_Width + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+		m_HiZHeight = (m_Height + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+		m_pHiZBuffer = new float[m_HiZWidth * m_HiZHeight];
+		m_pHiZDirty = new bool[m_HiZWidth * m_HiZHeight];
+		std::fill_n(m_pHiZBuffer, (m_HiZWidth * m_HiZHeight), FLT_MAX);
+		std::fill_n(m_pHiZDirty, (m_HiZWidth * m_HiZHeight), false);
+
+		m_NumRateTilesX = (m_Width + RATE_TILE_SIZE - 1) / RATE_TILE_SIZE;
+		m_NumRateTilesY = (m_Height + RATE_TILE_SIZE - 1) / RATE_TILE_SIZE;
+		m_pShadingRates = new ShadingRate[m_NumRateTilesX * m_NumRateTilesY];
+		m_pCoarseShades = new CoarseShade[m_NumRateTilesX * m_NumRateTilesY * MAX_COARSE_PIXELS_PER_RATE_TILE];
+		std::fill_n(m_pShadingRates, (m_NumRateTilesX * m_NumRateTilesY), ShadingRate::Rate1x1);
+
+		m_pJobSystem = std::make_unique<JobSystem>();
+		std::cout << GREEN << "Job system running on " << m_pJobSystem->GetNumThreads() << " threads" << RESET << std::endl;
+
+		//Split the screen in tiles, each tile is owned by one thread while rasterizing
+		m_NumTilesX = (m_Width + TILE_SIZE - 1) / TILE_SIZE;
+		m_NumTilesY = (m_Height + TILE_SIZE - 1) / TILE_SIZE;
+		std::vector<Tile> tiles(m_NumTilesX * m_NumTilesY);
+		for (int ty{ 0 }; ty < m_NumTilesY; ++ty)
+		{
+			for (int tx{ 0 }; tx < m_NumTilesX; ++tx)
+			{
+				Tile& tile{ tiles[tx + ty * m_NumTilesX] };
+				tile.minX = tx * TILE_SIZE;
+				tile.minY = ty * TILE_SIZE;
+				tile.maxX = std::min(tile.minX + TILE_SIZE, m_Width);
+				tile.maxY = std::min(tile.minY + TILE_SIZE, m_Height);
+			}
+		}
+		for (SoftwareFrame& frame : m_Frames)
+		{
+			frame.tiles = tiles;
+		}
+
 		//Initialize DirectX pipeline
 		if (SUCCEEDED(InitializeDirectX()))
 		{
@@ -35,12 +80,12 @@ namespace dae {
 		}
 
 		//Intialize textures
-		m_pVehicleDiffuseTexture = std::make_unique<Texture>(L"Resources/vehicle_diffuse.png", m_pDevice);
-		m_pVehicleGlossinessTexture = std::make_unique<Texture>(L"Resources/vehicle_gloss.png", m_pDevice);
-		m_pVehicleNormalTexture = std::make_unique<Texture>(L"Resources/vehicle_normal.png", m_pDevice);
-		m_pVehicleSpecularTexture = std::make_unique<Texture>(L"Resources/vehicle_specular.png", m_pDevice);
+		m_pVehicleDiffuseTexture = std::make_unique<Texture>(L"Resources/vehicle_diffuse.png", m_pDevice, *m_pJobSystem);
+		m_pVehicleGlossinessTexture = std::make_unique<Texture>(L"Resources/vehicle_gloss.png", m_pDevice, *m_pJobSystem, TexelFormat::R8);
+		m_pVehicleNormalTexture = std::make_unique<Texture>(L"Resources/vehicle_normal.png", m_pDevice, *m_pJobSystem);
+		m_pVehicleSpecularTexture = std::make_unique<Texture>(L"Resources/vehicle_specular.png", m_pDevice, *m_pJobSystem, TexelFormat::R8);
 
-		m_pFireDiffuseTexture = std::make_unique<Texture>(L"Resources/fireFX_diffuse.png", m_pDevice);
+		m_pFireDiffuseTexture = std::make_unique<Texture>(L"Resources/fireFX_diffuse.png", m_pDevice, *m_pJobSystem);
 
 
 		//Initialize effects
@@ -66,6 +111,16 @@ namespace dae {
 	Renderer::~Renderer()
 	{
 		delete[] m_pDepthBufferPixels;
+		delete[] m_pHiZBuffer;
+		delete[] m_pHiZDirty;
+		delete[] m_pVisibilityBuffer;
+		delete[] m_pDepthOwners;
+		delete[] m_pSampleDepths;
+		delete[] m_pSampleColors;
+		delete[] m_pSampleOwners;
+		delete[] m_pShadingRates;
+		delete[] m_pCoarseShades;
+		SDL_FreeSurface(m_pUpscaleBuffer);
 
 		// Direct X safe release macro (call release if exists)
 		SAFE_RELEASE(m_pRenderTargetView)
@@ -88,18 +143,6 @@ namespace dae {
 
 	void Renderer::ChangeSamplerState() noexcept
 	{
-		if (m_IsSofwareRasterizerMode)
-		{
-			std::cout << RED << "Not in hardware rasterizer, can not cycle sampler state setting\n" << RESET;
-			return;
-		}
-
-		if (!m_IsDirectXInitialized)
-		{
-			std::cout << RED << "DirectX not Initialized\n" << RESET;
-			return;
-		}
-
 		//Calculate new idx
 		uint8_t newId = static_cast<uint8_t>(m_SamplerState);
 		++newId %= static_cast<uint8_t>(SamplerState::COUNT);
@@ -122,6 +165,11 @@ namespace dae {
 		default: break;
 		}
 
+		// The software rasterizer reads m_SamplerState while shading, the effects need their technique switched
+		if (!m_IsDirectXInitialized)
+		{
+			return;
+		}
 		for (auto& m : m_Meshes)
 		{
 			m->SetSamplingMode(newId);
@@ -130,16 +178,36 @@ namespace dae {
 
 	void Renderer::Update(Timer* pTimer)
 	{
+		if (m_IsSofwareRasterizerMode && m_IsDynamicResolution)
+		{
+			UpdateRenderResolution(pTimer->GetElapsed());
+		}
+
 		m_Camera.Update(pTimer);
+		Matrix const viewProjection{ m_Camera.viewMatrix * m_Camera.projectionMatrix };
 
-		for (auto& m : m_Meshes)
+		m_MeshBounds.Resize(m_Meshes.size());
+		for (size_t i{ 0 }; i < m_Meshes.size(); ++i)
 		{
+			auto& m{ m_Meshes[i] };
 			if (m_IsRotationMode)
 			{
 				m->RotateY(TO_RADIANS*(45.f * pTimer->GetElapsed()));
 			}
-			m->UpdateEffectMatrices(m_Camera.viewMatrix * m_Camera.projectionMatrix);
+			m->UpdateEffectMatrices(viewProjection);
 			m->UpdateCameraPos(m_Camera.origin);
+			m_MeshBounds.Set(i, m->GetWorldBoundingSphere(), m->GetWorldBoundingBox());
+		}
+
+		//Meshes outside of the frustum skip the whole pipeline in both rasterizers
+		CullBounds(Frustum{ viewProjection }, m_MeshBounds, m_IsMeshVisible);
+		for (size_t i{ 0 }; i < m_Meshes.size(); ++i)
+		{
+			if (m_IsMeshVisible[i])
+			{
+				//The fire mesh is always rendered double sided
+				m_Meshes[i]->CullMeshlets(viewProjection, m_Camera.origin, i == 1 ? CullMode::None : m_CurrCullMode);
+			}
 		}
 	}
 
@@ -150,9 +218,235 @@ namespace dae {
 			RenderSoftware();
 			return;
 		}
+		m_IsFrameInFlight = false; // Would be stale by the time the software rasterizer is used again
 		RenderDirectXHardware();
 	}
 
+	void Renderer::ToggleTexelLayout()
+	{
+		if (!m_IsSofwareRasterizerMode)
+		{
+			std::cout << RED << "Not in software rasterizer, can not toggle the texel layout\n" << RESET;
+			return;
+		}
+
+		TexelLayout const layout{ m_pVehicleDiffuseTexture->GetTexelLayout() == TexelLayout::Linear ? TexelLayout::Morton : TexelLayout::Linear };
+		bool isApplied{ true };
+		for (Texture* pTexture : { m_pVehicleDiffuseTexture.get(), m_pVehicleNormalTexture.get(), m_pVehicleGlossinessTexture.get(), m_pVehicleSpecularTexture.get(), m_pFireDiffuseTexture.get() })
+		{
+			isApplied &= pTexture->SetTexelLayout(layout);
+		}
+
+		if (layout == TexelLayout::Morton)
+		{
+			std::cout << "Texel layout -> " << GREEN << "Morton";
+			if (!isApplied)
+			{
+				std::cout << YELLOW << " (textures that are not a power of two stay linear)";
+			}
+			std::cout << "\n" << RESET;
+			return;
+		}
+		std::cout << "Texel layout -> " << GREEN << "Linear\n";
+		std::cout << RESET;
+	}
+
+	void Renderer::BenchmarkRenderPaths()
+	{
+		if (!m_IsSofwareRasterizerMode)
+		{
+			std::cout << RED << "Not in software rasterizer, can not benchmark the render paths\n" << RESET;
+			return;
+		}
+
+		int constexpr NUM_ROUNDS{ 5 };
+		int constexpr NUM_FRAMES{ 20 }; // Per round
+		char const* const pathNames[]{ "Forward", "VisibilityBuffer", "ZPrepass" };
+		static_assert(std::size(pathNames) == static_cast<size_t>(RenderPath::COUNT));
+
+		// Average frame time and shaded fragments over NUM_FRAMES frames
+		auto const measure = [this]()
+			{
+				uint64_t shadedFragments{ 0 };
+				auto const start{ std::chrono::high_resolution_clock::now() };
+				for (int frame{ 0 }; frame < NUM_FRAMES; ++frame)
+				{
+					RenderSoftware();
+					shadedFragments += m_ShadedFragments;
+				}
+				std::chrono::duration<float, std::milli> const elapsed{ std::chrono::high_resolution_clock::now() - start };
+				return std::pair{ elapsed.count() / NUM_FRAMES, shadedFragments / NUM_FRAMES };
+			};
+
+		// The scene is not updated in between, so every path renders exactly the same frame.
+		// Every path is measured with and without 4x MSAA, the ratio is what anti-aliasing costs.
+		// The two take turns for a few rounds. The ratio of every round is printed, next to the medians.
+		char const* const samplerNames[]{ "point", "linear", "anisotropic" };
+		static_assert(std::size(samplerNames) == static_cast<size_t>(SamplerState::COUNT));
+		std::cout << YELLOW << "Benchmarking render paths (median of " << NUM_ROUNDS << " rounds of " << NUM_FRAMES << " frames each, at " << m_RenderWidth << "x" << m_RenderHeight
+			<< ", " << samplerNames[static_cast<size_t>(m_SamplerState)] << " sampling)\n" << RESET;
+		auto const median = [](std::array<float, NUM_ROUNDS> values)
+			{
+				std::nth_element(values.begin(), values.begin() + NUM_ROUNDS / 2, values.end());
+				return values[NUM_ROUNDS / 2];
+			};
+		RenderPath const currRenderPath{ m_CurrRenderPath };
+		bool const isMSAAEnabled{ m_IsMSAAEnabled };
+		CreateMSAABuffers();
+		for (uint8_t path{ 0 }; path < static_cast<uint8_t>(RenderPath::COUNT); ++path)
+		{
+			m_CurrRenderPath = static_cast<RenderPath>(path);
+			// With MSAA the visibility buffer path renders as forward (see RenderTile), it has no MSAA cost of its own
+			bool const hasMSAA{ m_CurrRenderPath != RenderPath::VisibilityBuffer };
+
+			std::array<float, NUM_ROUNDS> times{};
+			std::array<float, NUM_ROUNDS> msaaTimes{};
+			std::array<float, NUM_ROUNDS> ratios{};
+			uint64_t fragments{};
+			uint64_t msaaFragments{};
+			for (int round{ 0 }; round < NUM_ROUNDS; ++round)
+			{
+				if (hasMSAA)
+				{
+					m_IsMSAAEnabled = true;
+					std::tie(msaaTimes[round], msaaFragments) = measure();
+				}
+				m_IsMSAAEnabled = false;
+				std::tie(times[round], fragments) = measure();
+				ratios[round] = msaaTimes[round] / times[round];
+			}
+
+			std::cout << pathNames[path] << " -> " << GREEN << median(times) << " ms, " << fragments << " shaded fragments per frame" << RESET << " | 4x MSAA -> ";
+			if (!hasMSAA)
+			{
+				std::cout << YELLOW << "renders as Forward\n" << RESET;
+				continue;
+			}
+			std::cout << GREEN << median(msaaTimes) << " ms (" << median(ratios) << "x, rounds:";
+			for (float const ratio : ratios)
+			{
+				std::cout << " " << ratio;
+			}
+			std::cout << "), " << msaaFragments << " shaded fragments per frame\n" << RESET;
+		}
+		m_CurrRenderPath = currRenderPath;
+		m_IsMSAAEnabled = isMSAAEnabled;
+
+		// Same geometry for every path, so one mix of rasterization loops (without MSAA, it grows the bounding boxes)
+		uint32_t const* const pCounts{ m_Frames[m_RasterFrameIdx].rasterMethodCounts };
+		std::cout << "Triangles per rasterization loop -> " << GREEN
+			<< "tiny " << pCounts[static_cast<size_t>(RasterMethod::Tiny)]
+			<< ", block " << pCounts[static_cast<size_t>(RasterMethod::Block)]
+			<< ", span " << pCounts[static_cast<size_t>(RasterMethod::Span)]
+			<< ", scalar " << pCounts[static_cast<size_t>(RasterMethod::Scalar)] << "\n" << RESET;
+
+		if (m_IsVariableRateShading)
+		{
+			int rateCounts[static_cast<size_t>(ShadingRate::COUNT)]{};
+			for (int i{ 0 }; i < m_NumRateTilesX * m_NumRateTilesY; ++i)
+			{
+				++rateCounts[static_cast<size_t>(m_pShadingRates[i])];
+			}
+			std::cout << "Rate tiles per shading rate -> " << GREEN
+				<< "1x1 " << rateCounts[static_cast<size_t>(ShadingRate::Rate1x1)]
+				<< ", 1x2 " << rateCounts[static_cast<size_t>(ShadingRate::Rate1x2)]
+				<< ", 2x2 " << rateCounts[static_cast<size_t>(ShadingRate::Rate2x2)]
+				<< ", 4x4 " << rateCounts[static_cast<size_t>(ShadingRate::Rate4x4)] << "\n" << RESET;
+		}
+
+		BenchmarkTexelLayouts();
+	}
+
+	void Renderer::BenchmarkTexelLayouts()
+	{
+		// Walks the diffuse texture the way the rasterizer walks the screen: 8x8 blocks, one texel per pixel (bilinear), with the texture rotated under the screen.
+		// The distinct cache lines and pages a block touches are what it misses on with a cold cache, the time per sample shows what that costs.
+		int constexpr SIZE{ 512 };
+		int constexpr BLOCK_SIZE{ 8 };
+		int constexpr NUM_REPEATS{ 10 };
+		int constexpr CACHE_LINE_BITS{ 6 };
+		int constexpr PAGE_BITS{ 12 };
+		float constexpr ANGLES[]{ 0.f, 30.f, 45.f, 90.f };
+
+		Texture& texture{ *m_pVehicleDiffuseTexture };
+		TexelLayout const currLayout{ texture.GetTexelLayout() };
+		float const invWidth{ 1.f / static_cast<float>(texture.GetWidth()) };
+		float const invHeight{ 1.f / static_cast<float>(texture.GetHeight()) };
+
+		std::cout << YELLOW << "Benchmarking texel layouts (" << texture.GetWidth() << "x" << texture.GetHeight() << " texture, " << SIZE << "x" << SIZE << " texels walked in " << BLOCK_SIZE << "x" << BLOCK_SIZE << " blocks)\n" << RESET;
+		for (TexelLayout const layout : { TexelLayout::Linear, TexelLayout::Morton })
+		{
+			if (!texture.SetTexelLayout(layout))
+			{
+				continue;
+			}
+
+			for (float const angle : ANGLES)
+			{
+				float const cos{ std::cos(angle * TO_RADIANS) };
+				float const sin{ std::sin(angle * TO_RADIANS) };
+				auto const getUV = [&](int x, int y)
+					{
+						float const dx{ static_cast<float>(x - SIZE / 2) };
+						float const dy{ static_cast<float>(y - SIZE / 2) };
+						return Vector2{ .5f + (cos * dx - sin * dy) * invWidth, .5f + (sin * dx + cos * dy) * invHeight };
+					};
+				TexcoordDerivatives const derivatives{ { cos * invWidth, sin * invHeight }, { -sin * invWidth, cos * invHeight } };
+				Sampler constexpr sampler{ SamplerState::Linear };
+
+				// Footprint
+				uint64_t numLines{ 0 };
+				uint64_t numPages{ 0 };
+				size_t lines[BLOCK_SIZE * BLOCK_SIZE];
+				size_t pages[BLOCK_SIZE * BLOCK_SIZE];
+				for (int blockY{ 0 }; blockY < SIZE; blockY += BLOCK_SIZE)
+				{
+					for (int blockX{ 0 }; blockX < SIZE; blockX += BLOCK_SIZE)
+					{
+						for (int i{ 0 }; i < BLOCK_SIZE * BLOCK_SIZE; ++i)
+						{
+							size_t const offset{ texture.GetTexelOffset(getUV(blockX + i % BLOCK_SIZE, blockY + i / BLOCK_SIZE)) };
+							lines[i] = offset >> CACHE_LINE_BITS;
+							pages[i] = offset >> PAGE_BITS;
+						}
+						std::sort(std::begin(lines), std::end(lines));
+						std::sort(std::begin(pages), std::end(pages));
+						numLines += std::unique(std::begin(lines), std::end(lines)) - std::begin(lines);
+						numPages += std::unique(std::begin(pages), std::end(pages)) - std::begin(pages);
+					}
+				}
+
+				// Timing
+				float sum{ 0.f };
+				auto const start{ std::chrono::high_resolution_clock::now() };
+				for (int repeat{ 0 }; repeat < NUM_REPEATS; ++repeat)
+				{
+					for (int blockY{ 0 }; blockY < SIZE; blockY += BLOCK_SIZE)
+					{
+						for (int blockX{ 0 }; blockX < SIZE; blockX += BLOCK_SIZE)
+						{
+							for (int y{ blockY }; y < blockY + BLOCK_SIZE; ++y)
+							{
+								for (int x{ blockX }; x < blockX + BLOCK_SIZE; ++x)
+								{
+									sum += texture.Sample(getUV(x, y), derivatives, sampler).r;
+								}
+							}
+						}
+					}
+				}
+				std::chrono::duration<float, std::nano> const elapsed{ std::chrono::high_resolution_clock::now() - start };
+
+				float constexpr NUM_BLOCKS{ static_cast<float>(SIZE / BLOCK_SIZE * SIZE / BLOCK_SIZE) };
+				std::cout << (layout == TexelLayout::Linear ? "Linear" : "Morton") << ", rotated " << angle << " degrees -> " << GREEN
+					<< elapsed.count() / (NUM_REPEATS * SIZE * SIZE) << " ns per sample, "
+					<< numLines / NUM_BLOCKS << " cache lines and " << numPages / NUM_BLOCKS << " pages per block"
+					<< (sum < 0.f ? "" : "\n") << RESET; // Uses the sum, so the samples are not optimized away
+			}
+		}
+		static_cast<void>(texture.SetTexelLayout(currLayout));
+	}
+
 	void Renderer::RenderDirectXHardware() const
 	{
 		if (!m_IsDirectXInitialized)
@@ -166,13 +460,17 @@ namespace dae {
 		m_pDeviceContext->ClearDepthStencilView(m_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
 		// Set pipeline + invoke drawcalls
-		for (auto& m : m_Meshes)
+		for (size_t i{ 0 }; i < m_Meshes.size(); ++i)
 		{
-			if (!m_DisplayFireMesh && m_Meshes.size() > 1 && m == m_Meshes[1]) // Hard coded to array idx 1 currently since it's just a demo
+			if (!m_DisplayFireMesh && i == 1) // Hard coded to array idx 1 currently since it's just a demo
+			{
+				continue;
+			}
+			if (!m_IsMeshVisible[i])
 			{
 				continue;
 			}
-			m->Render(m_pDeviceContext);
+			m_Meshes[i]->Render(m_pDeviceContext);
 		}
 
 		// present backbuffer (swap)
@@ -181,148 +479,529 @@ namespace dae {
 
 	void Renderer::RenderSoftware() const
 	{
-		//Lock BackBuffer
-		SDL_LockSurface(m_pBackBuffer);
-
-		std::fill_n(m_pDepthBufferPixels, m_Width * m_Height, FLT_MAX);
-		std::fill_n(m_pBackBufferPixels, m_Width * m_Height, 0);
-
-		//clear the background
-		if (m_DisplayUniformClearColor)
+		if (!m_IsFramePipelined)
 		{
-			SDL_FillRect(m_pBackBuffer, nullptr, SDL_MapRGB(m_pBackBuffer->format, static_cast<uint8_t>(UNIFORM_COLOR[0] * 255), static_cast<uint8_t>(UNIFORM_COLOR[1] * 255), static_cast<uint8_t>(UNIFORM_COLOR[2] * 255)));
+			m_IsFrameInFlight = false;
+			m_pJobSystem->Wait(RunGeometryStage(m_Frames[m_RasterFrameIdx]));
+			RasterizeFrame();
+			return;
 		}
-		else
+
+		// The very first pipelined frame has nothing to rasterize yet
+		if (!m_IsFrameInFlight)
 		{
-			SDL_FillRect(m_pBackBuffer, nullptr, SDL_MapRGB(m_pBackBuffer->format, static_cast<uint8_t>(SOFTWARE_COLOR[0] * 255), static_cast<uint8_t>(SOFTWARE_COLOR[1] * 255), static_cast<uint8_t>(SOFTWARE_COLOR[2] * 255)));
+			m_pJobSystem->Wait(RunGeometryStage(m_Frames[m_RasterFrameIdx]));
+			m_IsFrameInFlight = true;
 		}
 
-		for (auto & m : m_Meshes)
+		// Frame N+1 (the state of the last Update) is transformed and set up while frame N is rasterized and presented.
+		// Everything the geometry stage writes is either in its own frame or only read by the geometry stage itself.
+		uint32_t const geometryFrameIdx{ 1 - m_RasterFrameIdx };
+		Job* const pGeometryJob{ RunGeometryStage(m_Frames[geometryFrameIdx]) };
+		RasterizeFrame();
+		m_pJobSystem->Wait(pGeometryJob);
+		m_RasterFrameIdx = geometryFrameIdx;
+	}
+
+	Job* Renderer::RunGeometryStage(SoftwareFrame& frame) const
+	{
+		frame.cameraOrigin = m_Camera.origin;
+		frame.renderWidth = m_RenderWidth;
+		frame.renderHeight = m_RenderHeight;
+		frame.isMSAAEnabled = m_IsMSAAEnabled;
+
+		//Geometry stage: transform every mesh and set up its triangles.
+		//Every visible meshlet gets a contiguous range of triangle slots up front, so the jobs never resize the triangle list.
+		//This part reads the meshes, so it has to be done before the next Update.
+		frame.triangles.clear();
+		m_MeshGeometry.resize(m_Meshes.size());
+		for (size_t i{ 0 }; i < m_Meshes.size(); ++i)
 		{
-			//Hard coded to fire mesh since we don't support this in software currently.
-			if (m == m_Meshes[1])
+			MeshGeometry& geometry{ m_MeshGeometry[i] };
+			geometry.numTriangles = 0;
+
+			//Hard coded to the fire mesh, like the hardware rasterizer
+			if ((i == 1 && !m_DisplayFireMesh) || !m_IsMeshVisible[i])
 			{
 				continue;
 			}
-			//Meshes defined in world space before the transform function,
-			std::vector<Vector2> vertices_screenSpace{};
-			//convert each NDC coordinates to screen space / raster space
-			VertexTransformationFunction(vertices_screenSpace, m.get());
+			Mesh* const pMesh{ m_Meshes[i].get() };
+			PrepareVertexTransformation(pMesh, geometry.vertexBlocks);
+
+			auto const& meshlets{ pMesh->GetMeshlets() };
+			auto const& visibleMeshlets{ pMesh->GetVisibleMeshlets() };
+			geometry.firstTriangle = frame.triangles.size();
+			geometry.meshletTriangleOffsets.resize(visibleMeshlets.size());
+			for (size_t m{ 0 }; m < visibleMeshlets.size(); ++m)
+			{
+				geometry.meshletTriangleOffsets[m] = static_cast<uint32_t>(geometry.firstTriangle + geometry.numTriangles);
+				geometry.numTriangles += meshlets[visibleMeshlets[m]].triangleCount;
+			}
+			frame.triangles.resize(geometry.firstTriangle + geometry.numTriangles);
+		}
 
-			switch (m->GetPrimitiveTopology())
+		//Per mesh: vertex blocks in parallel, then triangle setup per meshlet once all of its vertices are transformed.
+		//Meshes don't depend on each other, the root only finishes once every mesh did.
+		size_t constexpr VERTEX_BLOCKS_PER_JOB{ 32 };
+		size_t constexpr MESHLETS_PER_JOB{ 4 };
+		Job* const pGeometryJob{ m_pJobSystem->CreateJob({}) };
+		for (size_t i{ 0 }; i < m_Meshes.size(); ++i)
+		{
+			MeshGeometry const& geometry{ m_MeshGeometry[i] };
+			if (geometry.numTriangles == 0)
 			{
-			case PrimitiveTopology::TriangleList:
-				// Use parallel execution for triangle list
-				std::for_each(
-					std::execution::par_unseq,  // threading execution policy - threading would be slightly better using a "custom" system but for this demo it is sufficient
-					m->GetIndices().begin(), m->GetIndices().end(),
-					[this, &m, &vertices_screenSpace](uint32_t v)
+				continue;
+			}
+			Mesh* const pMesh{ m_Meshes[i].get() };
+
+			Job* const pVertexJob{ m_pJobSystem->CreateParallelFor(geometry.vertexBlocks.size(), VERTEX_BLOCKS_PER_JOB,
+				[this, pMesh, &geometry](size_t first, size_t last)
+				{
+					VertexTransformationFunction(pMesh, geometry.vertexBlocks.data() + first, last - first);
+				}, pGeometryJob) };
+
+			// Every triangle writes its own slot, so setup needs no synchronization
+			Job* const pSetupJob{ m_pJobSystem->CreateParallelFor(pMesh->GetVisibleMeshlets().size(), MESHLETS_PER_JOB,
+				[this, pMesh, &geometry, &frame](size_t first, size_t last)
+				{
+					auto const& meshlets{ pMesh->GetMeshlets() };
+					auto const& visibleMeshlets{ pMesh->GetVisibleMeshlets() };
+					for (size_t m{ first }; m < last; ++m)
 					{
-						if (v % 3 == 0)
-						{  // Only process every 3rd index
-							RenderTriangle(m.get(), vertices_screenSpace, v, false);
+						Meshlet const& meshlet{ meshlets[visibleMeshlets[m]] };
+						TriangleSetup* const pTriangles{ &frame.triangles[geometry.meshletTriangleOffsets[m]] };
+						for (uint32_t t{ 0 }; t < meshlet.triangleCount; ++t)
+						{
+							SetupMeshTriangle(pMesh, meshlet.firstTriangle + t, pTriangles[t], frame);
 						}
-					});
-				break;
-			case PrimitiveTopology::TriangleStrip:
-				std::for_each(
-					std::execution::par_unseq,  // Parallel execution policy - threading would be slightly better using a "custom" system but for this demo it is sufficient
-					m->GetIndices().begin(), m->GetIndices().end() - 2,
-					[this, &m, &vertices_screenSpace](uint32_t v)
+					}
+				}, pGeometryJob) };
+
+			m_pJobSystem->AddContinuation(pVertexJob, pSetupJob);
+			m_pJobSystem->Run(pSetupJob);
+			m_pJobSystem->Run(pVertexJob);
+		}
+
+		Job* const pBinJob{ m_pJobSystem->CreateJob([this, &frame]()
+			{
+				// Clipping appends new triangles, only a handful of triangles need it so it is done serially
+				for (size_t i{ 0 }; i < m_Meshes.size(); ++i)
+				{
+					MeshGeometry const& geometry{ m_MeshGeometry[i] };
+					for (size_t t{ geometry.firstTriangle }; t < geometry.firstTriangle + geometry.numTriangles; ++t)
 					{
-						RenderTriangle(m.get(), vertices_screenSpace, v, v % 2);
-					});
-				break;
-			default:
-				break;
+						if (frame.triangles[t].clipPlanes)
+						{
+							ClipTriangle(m_Meshes[i].get(), TriangleSetup{ frame.triangles[t] }, frame);
+						}
+					}
+				}
+
+				//Binning stage: sort the triangles into the tiles they overlap
+				BinTriangles(frame);
+			}) };
+		m_pJobSystem->AddContinuation(pGeometryJob, pBinJob);
+		m_pJobSystem->Run(pBinJob);
+		m_pJobSystem->Run(pGeometryJob);
+		return pBinJob;
+	}
+
+	void Renderer::RasterizeFrame() const
+	{
+		SoftwareFrame& frame{ m_Frames[m_RasterFrameIdx] };
+
+		//Lock BackBuffer
+		SDL_LockSurface(m_pBackBuffer);
+
+		//Only the part that gets rendered to is cleared, whatever is left outside of it is never read.
+		//The hierarchical depth may include stale depths of blocks on the edge, that only makes it more conservative.
+		for (int py{ 0 }; py < frame.renderHeight; ++py)
+		{
+			std::fill_n(m_pDepthBufferPixels + py * m_Width, frame.renderWidth, FLT_MAX);
+			if (m_CurrRenderPath == RenderPath::VisibilityBuffer)
+			{
+				std::fill_n(m_pVisibilityBuffer + py * m_Width, frame.renderWidth, VisibilityTexel{ INVALID_TRIANGLE });
 			}
 		}
+		std::fill_n(m_pHiZBuffer, m_HiZWidth * m_HiZHeight, FLT_MAX);
+		std::fill_n(m_pHiZDirty, m_HiZWidth * m_HiZHeight, false);
+
+		//clear the background
+		float const* const clearColor{ m_DisplayUniformClearColor ? UNIFORM_COLOR : SOFTWARE_COLOR };
+		uint32_t const mappedClearColor{ SDL_MapRGB(m_pBackBuffer->format, static_cast<uint8_t>(clearColor[0] * 255), static_cast<uint8_t>(clearColor[1] * 255), static_cast<uint8_t>(clearColor[2] * 255)) };
+		SDL_Rect const renderRect{ 0, 0, frame.renderWidth, frame.renderHeight };
+		SDL_FillRect(m_pBackBuffer, &renderRect, mappedClearColor);
+
+		//Rasterization stage: every tile is rasterized by exactly one thread, tiles never share pixels so no synchronization is needed
+		m_pJobSystem->ParallelFor(frame.tiles.size(), 1,
+			[this, &frame, mappedClearColor](size_t first, size_t last)
+			{
+				for (size_t t{ first }; t < last; ++t)
+				{
+					Tile const& tile{ frame.tiles[t] };
+					if (m_IsVariableRateShading)
+					{
+						ResetCoarseShades(tile);
+					}
+
+					if (!frame.isMSAAEnabled)
+					{
+						RenderTile(tile);
+					}
+					else
+					{
+						// The samples of a tile are cleared right before it is rasterized, so they are still in the cache while it is
+						for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+						{
+							for (int py{ tile.minY }; py < tile.maxY; ++py)
+							{
+								int const rowIdx{ s * m_Width * m_Height + py * m_Width };
+								std::fill(m_pSampleDepths + rowIdx + tile.minX, m_pSampleDepths + rowIdx + tile.maxX, FLT_MAX);
+								std::fill(m_pSampleColors + rowIdx + tile.minX, m_pSampleColors + rowIdx + tile.maxX, mappedClearColor);
+							}
+						}
+						RenderTile(tile);
+						ResolveTile(tile);
+					}
+
+					// The final colors of the tile are still in the cache, pick the shading rates of the next frame from them
+					if (m_IsVariableRateShading)
+					{
+						UpdateShadingRates(tile);
+					}
+				}
+			});
+
+		m_ShadedFragments = 0;
+		for (Tile const& tile : frame.tiles)
+		{
+			m_ShadedFragments += tile.shadedFragments;
+		}
 
 		//@END
 		//Update SDL Surface
-		SDL_UnlockSurface(m_pBackBuffer);
-		SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+		if (frame.renderWidth == m_Width && frame.renderHeight == m_Height)
+		{
+			SDL_UnlockSurface(m_pBackBuffer);
+			SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+		}
+		else
+		{
+			PresentUpscaled(frame.renderWidth, frame.renderHeight);
+			SDL_UnlockSurface(m_pBackBuffer);
+			SDL_BlitSurface(m_pUpscaleBuffer, 0, m_pFrontBuffer, 0);
+		}
 		SDL_UpdateWindowSurface(m_pWindow);
 	}
 
-	void Renderer::VertexTransformationFunction(std::vector<Vector2>& screenSpace, Mesh* mesh) const
+	void Renderer::PresentUpscaled(int renderWidth, int renderHeight) const
+	{
+		// Bilinear upscale of the rendered part of the back buffer to the whole window, with 8 bit weights.
+		// Every destination column maps to the same two source columns on every row, so those are only calculated once.
+		struct SourceColumn
+		{
+			int x0{};
+			int x1{};
+			uint32_t weight{}; // Of x1, out of 256
+		};
+		auto const mapToSource = [](int dst, int srcSize, int dstSize)
+			{
+				// Pixel centers line up, the edges clamp
+				float const src{ std::max((static_cast<float>(dst) + 0.5f) * static_cast<float>(srcSize) / static_cast<float>(dstSize) - 0.5f, 0.f) };
+				int const src0{ std::min(static_cast<int>(src), srcSize - 1) };
+				return SourceColumn{ src0, std::min(src0 + 1, srcSize - 1), static_cast<uint32_t>((src - static_cast<float>(src0)) * 256.f) };
+			};
+
+		std::vector<SourceColumn> columns(m_Width);
+		for (int x{ 0 }; x < m_Width; ++x)
+		{
+			columns[x] = mapToSource(x, renderWidth, m_Width);
+		}
+
+		SDL_LockSurface(m_pUpscaleBuffer);
+		auto* const pDst{ static_cast<uint32_t*>(m_pUpscaleBuffer->pixels) };
+		int const dstPitch{ m_pUpscaleBuffer->pitch / static_cast<int>(sizeof(uint32_t)) };
+
+		size_t constexpr ROWS_PER_JOB{ 16 };
+		m_pJobSystem->ParallelFor(m_Height, ROWS_PER_JOB,
+			[&](size_t first, size_t last)
+			{
+				for (int y{ static_cast<int>(first) }; y < static_cast<int>(last); ++y)
+				{
+					SourceColumn const row{ mapToSource(y, renderHeight, m_Height) };
+					uint32_t const* const pRow0{ m_pBackBufferPixels + row.x0 * m_Width };
+					uint32_t const* const pRow1{ m_pBackBufferPixels + row.x1 * m_Width };
+					uint32_t* const pDstRow{ pDst + y * dstPitch };
+					for (int x{ 0 }; x < m_Width; ++x)
+					{
+						SourceColumn const& column{ columns[x] };
+						uint32_t const top{ LerpPackedColor(pRow0[column.x0], pRow0[column.x1], column.weight) };
+						uint32_t const bottom{ LerpPackedColor(pRow1[column.x0], pRow1[column.x1], column.weight) };
+						pDstRow[x] = LerpPackedColor(top, bottom, row.weight);
+					}
+				}
+			});
+		SDL_UnlockSurface(m_pUpscaleBuffer);
+	}
+
+	void Renderer::UpdateRenderResolution(float elapsedSec) noexcept
+	{
+		// Smoothed, a single slow frame should not change the resolution
+		float constexpr SMOOTHING{ 0.1f };
+		m_AverageFrameTime += (elapsedSec - m_AverageFrameTime) * SMOOTHING;
+
+		// Hysteresis: wait until the average reflects the last resize, and don't react to frame times close to the target.
+		// Shrinking reacts more than growing, a frame too late is worse than a few pixels too little.
+		int constexpr RESIZE_COOLDOWN_FRAMES{ 15 };
+		float constexpr SHRINK_THRESHOLD{ 1.05f };
+		float constexpr GROW_THRESHOLD{ 0.8f };
+		float constexpr GROW_STEP{ 1.05f };
+		float constexpr MIN_SCALE{ 0.5f };
+		if (++m_FramesSinceResize < RESIZE_COOLDOWN_FRAMES)
+		{
+			return;
+		}
+
+		float scale{ GetRenderScale() };
+		if (m_AverageFrameTime > m_TargetFrameTime * SHRINK_THRESHOLD)
+		{
+			// Rasterization cost goes with the pixel count, so with the square of the scale
+			scale *= std::sqrt(m_TargetFrameTime / m_AverageFrameTime);
+		}
+		else if (m_AverageFrameTime < m_TargetFrameTime * GROW_THRESHOLD)
+		{
+			scale *= GROW_STEP;
+		}
+		else
+		{
+			return;
+		}
+
+		int const oldRenderWidth{ m_RenderWidth };
+		SetRenderResolution(static_cast<int>(static_cast<float>(m_Width) * std::clamp(scale, MIN_SCALE, 1.f)));
+		if (m_RenderWidth != oldRenderWidth)
+		{
+			m_FramesSinceResize = 0;
+		}
+	}
+
+	void Renderer::SetRenderResolution(int renderWidth) noexcept
+	{
+		// Whole SIMD chunks per row, the height follows from the aspect ratio of the window
+		int const minWidth{ std::min(m_Width, simd::WIDTH) };
+		m_RenderWidth = std::clamp(renderWidth / simd::WIDTH * simd::WIDTH, minWidth, m_Width);
+		m_RenderHeight = m_RenderWidth == m_Width ? m_Height : std::max((m_RenderWidth * m_Height + m_Width / 2) / m_Width, 1);
+	}
+
+	void Renderer::PrepareVertexTransformation(Mesh* mesh, std::vector<uint32_t>& vertexBlocks) const
+	{
+		// Prepare the output container
+		VertexInputStream const& input{ mesh->GetVertexInput() };
+		mesh->GetVertexOutput_Ref().Resize(input.positionX.size());
+
+		// Only the blocks of simd::WIDTH vertices that a visible meshlet uses are transformed
+		std::vector<bool> isBlockUsed(input.positionX.size() / simd::WIDTH, false);
+		auto const& meshlets{ mesh->GetMeshlets() };
+		auto const& meshletVertices{ mesh->GetMeshletVertices() };
+		for (uint32_t const meshletIdx : mesh->GetVisibleMeshlets())
+		{
+			Meshlet const& meshlet{ meshlets[meshletIdx] };
+			for (uint32_t v{ meshlet.firstVertex }; v < meshlet.firstVertex + meshlet.vertexCount; ++v)
+			{
+				isBlockUsed[meshletVertices[v] / simd::WIDTH] = true;
+			}
+		}
+
+		vertexBlocks.clear();
+		for (size_t block{ 0 }; block < isBlockUsed.size(); ++block)
+		{
+			if (isBlockUsed[block])
+			{
+				vertexBlocks.emplace_back(static_cast<uint32_t>(block));
+			}
+		}
+	}
+
+	void Renderer::VertexTransformationFunction(Mesh* mesh, uint32_t const* pBlocks, size_t numBlocks) const
 	{
 		//projection stage:
 		//model -> world space -> world -> view space 
-		auto const m{ mesh->GetWorldMatrix() * m_Camera.viewMatrix * m_Camera.projectionMatrix };
+		Matrix const& world{ mesh->GetWorldMatrix() };
+		auto const m{ world * m_Camera.viewMatrix * m_Camera.projectionMatrix };
 
-		// Prepare the output container
-		screenSpace.resize(mesh->GetVertices().size());
-		mesh->GetVertices_Out_Ref().resize(mesh->GetVertices().size());
-
-		// Transform vertices in parallel
-		std::transform(
-			std::execution::par,  // Parallel execution policy
-			mesh->GetVertices().begin(), mesh->GetVertices().end(),
-			mesh->GetVertices_Out_Ref().begin(),
-			[&](auto const& v) {
-				Vertex_Out vOut{};
-				vOut.texcoord = v.texcoord;
-
-				vOut.position = m.TransformPoint(v.position.ToPoint4());
-
-				vOut.normal = mesh->GetWorldMatrix().TransformVector(v.normal);
-				vOut.tangent = mesh->GetWorldMatrix().TransformVector(v.tangent);
-
-				// View -> clipping space (NDC)
-				float const inverseWComponent{ 1.f / vOut.position.w };
-				vOut.position.x *= inverseWComponent;
-				vOut.position.y *= inverseWComponent;	
-				vOut.position.z *= inverseWComponent;
-
-				// Convert to screen space (raster space)
-				float const x_screen{ (vOut.position.x + 1) * 0.5f * static_cast<float>(m_Width) }; //center of pixel
-				float const y_screen{ (1 - vOut.position.y) * 0.5f * static_cast<float>(m_Height) };
-
-				// Store screen space coordinates
-				auto const idx{ &v - mesh->GetVertices().data() }; // Calculate correct idx
-				screenSpace[idx] = { x_screen, y_screen };
-
-				return vOut;
-			});
+		VertexInputStream const& input{ mesh->GetVertexInput() };
+		VertexOutputStream& output{ mesh->GetVertexOutput_Ref() };
+
+		// Every matrix element broadcast to all lanes, [row][column]
+		simd::Float worldViewProjection[4][4]{};
+		simd::Float worldLanes[4][4]{};
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				worldViewProjection[r][c] = simd::SetFloat(m[r][c]);
+				worldLanes[r][c] = simd::SetFloat(world[r][c]);
+			}
+		}
+
+		simd::Float const one{ simd::SetFloat(1.f) };
+		simd::Float const halfWidth{ simd::SetFloat(0.5f * static_cast<float>(m_RenderWidth)) };
+		simd::Float const halfHeight{ simd::SetFloat(0.5f * static_cast<float>(m_RenderHeight)) };
+
+		// Row vector times matrix, with an implicit 1 as w for points
+		auto const transformPoint = [](simd::Float const (&matrix)[4][4], int c, simd::Float x, simd::Float y, simd::Float z)
+			{
+				return simd::Add(simd::Add(simd::Mul(x, matrix[0][c]), simd::Mul(y, matrix[1][c])), simd::Add(simd::Mul(z, matrix[2][c]), matrix[3][c]));
+			};
+		auto const transformVector = [](simd::Float const (&matrix)[4][4], int c, simd::Float x, simd::Float y, simd::Float z)
+			{
+				return simd::Add(simd::Add(simd::Mul(x, matrix[0][c]), simd::Mul(y, matrix[1][c])), simd::Mul(z, matrix[2][c]));
+			};
+
+		// simd::WIDTH vertices per block, the streams are padded so there is no remainder loop
+		for (size_t block{ 0 }; block < numBlocks; ++block)
+		{
+			size_t const i{ pBlocks[block] * size_t{ simd::WIDTH } };
+
+			simd::Float const x{ simd::Load(&input.positionX[i]) };
+			simd::Float const y{ simd::Load(&input.positionY[i]) };
+			simd::Float const z{ simd::Load(&input.positionZ[i]) };
+
+			// Model -> clipping space
+			simd::Float const clipX{ transformPoint(worldViewProjection, 0, x, y, z) };
+			simd::Float const clipY{ transformPoint(worldViewProjection, 1, x, y, z) };
+			simd::Float const clipZ{ transformPoint(worldViewProjection, 2, x, y, z) };
+			simd::Float const clipW{ transformPoint(worldViewProjection, 3, x, y, z) };
+			simd::Store(&output.clipX[i], clipX);
+			simd::Store(&output.clipY[i], clipY);
+			simd::Store(&output.clipZ[i], clipZ);
+			simd::Store(&output.clipW[i], clipW);
+
+			// Clipping space -> NDC -> screen space (raster space), garbage for vertices behind the camera but those get clipped before they are used
+			simd::Float const invW{ simd::Div(one, clipW) };
+			simd::Store(&output.invW[i], invW);
+			simd::Store(&output.depth[i], simd::Mul(clipZ, invW));
+			simd::Store(&output.screenX[i], simd::Add(simd::Mul(simd::Mul(clipX, invW), halfWidth), halfWidth));
+			simd::Store(&output.screenY[i], simd::Sub(halfHeight, simd::Mul(simd::Mul(clipY, invW), halfHeight)));
+
+			// Model -> world space
+			simd::Store(&output.worldX[i], transformPoint(worldLanes, 0, x, y, z));
+			simd::Store(&output.worldY[i], transformPoint(worldLanes, 1, x, y, z));
+			simd::Store(&output.worldZ[i], transformPoint(worldLanes, 2, x, y, z));
+
+			simd::Float const normalX{ simd::Load(&input.normalX[i]) };
+			simd::Float const normalY{ simd::Load(&input.normalY[i]) };
+			simd::Float const normalZ{ simd::Load(&input.normalZ[i]) };
+			simd::Store(&output.normalX[i], transformVector(worldLanes, 0, normalX, normalY, normalZ));
+			simd::Store(&output.normalY[i], transformVector(worldLanes, 1, normalX, normalY, normalZ));
+			simd::Store(&output.normalZ[i], transformVector(worldLanes, 2, normalX, normalY, normalZ));
+
+			simd::Float const tangentX{ simd::Load(&input.tangentX[i]) };
+			simd::Float const tangentY{ simd::Load(&input.tangentY[i]) };
+			simd::Float const tangentZ{ simd::Load(&input.tangentZ[i]) };
+			simd::Store(&output.tangentX[i], transformVector(worldLanes, 0, tangentX, tangentY, tangentZ));
+			simd::Store(&output.tangentY[i], transformVector(worldLanes, 1, tangentX, tangentY, tangentZ));
+			simd::Store(&output.tangentZ[i], transformVector(worldLanes, 2, tangentX, tangentY, tangentZ));
+		}
 	}
 
-	void Renderer::RenderTriangle(Mesh* m, std::vector<Vector2> const& vertices, uint32_t startVertex, bool swapVertex) const
+	void Renderer::SetupMeshTriangle(Mesh* mesh, uint32_t t, TriangleSetup& triangle, SoftwareFrame const& frame) const
 	{
-		//"Clipping" Stage
-		const size_t idx1{ m->GetIndices()[startVertex + (2 * swapVertex)] };
-		const size_t idx2{ m->GetIndices()[startVertex + 1] };
-		const size_t idx3{ m->GetIndices()[startVertex + (!swapVertex * 2)] };
+		// t is the index of the triangle in the whole mesh
+		auto const& indices{ mesh->GetIndices() };
+		auto const& input{ mesh->GetVertexInput() };
+		auto const& output{ mesh->GetVertexOutput() };
+		bool const isTriangleList{ mesh->GetPrimitiveTopology() == PrimitiveTopology::TriangleList };
+
+		// Every odd triangle of a strip has its winding flipped
+		uint32_t const startVertex{ isTriangleList ? t * 3 : t };
+		bool const swapVertex{ !isTriangleList && (t % 2) };
+		uint32_t const idx1{ indices[startVertex + (2 * swapVertex)] };
+		uint32_t const idx2{ indices[startVertex + 1] };
+		uint32_t const idx3{ indices[startVertex + (!swapVertex * 2)] };
 
 		// Not a triangle when 2 vertices are equal
 		if (idx1 == idx2 || idx2 == idx3 || idx3 == idx1)
 		{
+			triangle.pMesh = nullptr;
 			return;
 		}
 
 		//Frustum Culling
-		if (Utils::IsTriangleOutsideFrustum(m, static_cast<uint32_t>(idx1), static_cast<uint32_t>(idx2), static_cast<uint32_t>(idx3)))
-			return; //clipping could be applied here instead of just returning.
+		Vector4 const clip1{ output.GetClipPosition(idx1) };
+		Vector4 const clip2{ output.GetClipPosition(idx2) };
+		Vector4 const clip3{ output.GetClipPosition(idx3) };
+		if (Utils::IsTriangleOutsideFrustum(clip1, clip2, clip3))
+		{
+			triangle.pMesh = nullptr;
+			return;
+		}
+
+		// Crosses the near plane or leaves the guard band, clipped afterwards
+		triangle.clipPlanes = Utils::GetTriangleClipPlanes(clip1, clip2, clip3);
+		if (triangle.clipPlanes)
+		{
+			triangle.pMesh = nullptr;
+			triangle.vertexIndices[0] = idx1;
+			triangle.vertexIndices[1] = idx2;
+			triangle.vertexIndices[2] = idx3;
+			return;
+		}
+
+		if (!SetupTriangle(mesh, output.GetProjectedVertex(input, idx1), output.GetProjectedVertex(input, idx2), output.GetProjectedVertex(input, idx3), triangle, frame))
+		{
+			triangle.pMesh = nullptr;
+		}
+	}
 
+	ProjectedVertex Renderer::ProjectVertex(Vertex_Out const& v) const
+	{
+		// Same mapping as the vertex stage, for vertices created by clipping
+		float const inverseWComponent{ 1.f / v.position.w };
+
+		ProjectedVertex projected{};
+		projected.screenPosition.x = (v.position.x * inverseWComponent + 1) * 0.5f * static_cast<float>(m_RenderWidth);
+		projected.screenPosition.y = (1 - v.position.y * inverseWComponent) * 0.5f * static_cast<float>(m_RenderHeight);
+		projected.depth = v.position.z * inverseWComponent;
+		projected.invW = inverseWComponent;
+		projected.texcoord = v.texcoord;
+		projected.normal = v.normal;
+		projected.tangent = v.tangent;
+		projected.worldPosition = v.worldPosition;
+		return projected;
+	}
 
-		//Rasterization stage
-		const Vector2& vert0{ vertices[idx1] };
-		const Vector2& vert1{ vertices[idx2] };
-		const Vector2& vert2{ vertices[idx3] };
-		float const totalTriangleArea{ (vert1.x - vert0.x) * (vert2.y - vert0.y) - (vert1.y - vert0.y) * (vert2.x - vert0.x) };
+	bool Renderer::SetupTriangle(Mesh const* m, ProjectedVertex v0, ProjectedVertex v1, ProjectedVertex v2, TriangleSetup& triangle, SoftwareFrame const& frame) const
+	{
+		//Snap the vertices to the 16.8 fixed point grid
+		auto const toFixedPoint = [](Vector2 const& v) -> Int2
+			{
+				return { static_cast<int>(std::lround(v.x * SUBPIXEL_STEPS)), static_cast<int>(std::lround(v.y * SUBPIXEL_STEPS)) };
+			};
+		Int2 vert0{ toFixedPoint(v0.screenPosition) };
+		Int2 vert1{ toFixedPoint(v1.screenPosition) };
+		Int2 vert2{ toFixedPoint(v2.screenPosition) };
+
+		// Exact (twice the) signed area in 1/65536 pixel units
+		int64_t const totalTriangleArea{ static_cast<int64_t>(vert1.x - vert0.x) * (vert2.y - vert0.y) - static_cast<int64_t>(vert1.y - vert0.y) * (vert2.x - vert0.x) };
+		if (totalTriangleArea == 0)
+		{
+			return false; // Degenerate after snapping, covers no pixel centers
+		}
 
-		switch (m_CurrCullMode)
+		//The fire mesh is always rendered double sided
+		switch (IsTransparent(m) ? CullMode::None : m_CurrCullMode)
 		{
 		case CullMode::Back:
-			if (totalTriangleArea < 0.f)
+			if (totalTriangleArea < 0)
 			{
-				return; // Back-facing, cull it
+				return false; // Back-facing, cull it
 			}
 			break;
 		case CullMode::Front:
-			if (totalTriangleArea > 0.f)
+			if (totalTriangleArea > 0)
 			{
-				return; // Front-facing, cull it
+				return false; // Front-facing, cull it
 			}
 			break;
 		case CullMode::None: // no face culling necessary
@@ -331,106 +1010,1108 @@ namespace dae {
 			break;
 		}
 
-		float const invTotalTriangleArea{ 1 / totalTriangleArea };
+		triangle.pMesh = m;
 
-		//Bounding boxes logic - only loop over pixels within the smallest possible bounding box
-		//Small margin is required to prevent "black lines"
-		Vector2 topLeft{ Vector2::Min(vert0,Vector2::Min(vert1,vert2)) - Vector2{1.f, 1.f} };
-		Vector2 topRight{ Vector2::Max(vert0,Vector2::Max(vert1,vert2)) + Vector2{1.f, 1.f} };
-		
-		// prevent looping over something off-screen
-		topLeft.x = std::clamp(topLeft.x, 0.f, static_cast<float>(m_Width));
-		topLeft.y = std::clamp(topLeft.y, 0.f, static_cast<float>(m_Height));
-		topRight.x = std::clamp(topRight.x, 0.f, static_cast<float>(m_Width));
-		topRight.y = std::clamp(topRight.y, 0.f, static_cast<float>(m_Height));
+		// The edge functions expect a positive area, flip the winding of the ones that survived culling with a negative area
+		if (totalTriangleArea < 0)
+		{
+			std::swap(vert1, vert2);
+			std::swap(v1, v2);
+		}
 
-		for (int px{ static_cast<int>(topLeft.x) }; px < static_cast<int>(topRight.x); ++px)
+		triangle.edges[0] = CreateEdgeFunction(vert1, vert2);
+		triangle.edges[1] = CreateEdgeFunction(vert2, vert0);
+		triangle.edges[2] = CreateEdgeFunction(vert0, vert1);
+		triangle.invArea = static_cast<float>(SUBPIXEL_STEPS) / static_cast<float>(std::abs(totalTriangleArea));
+		triangle.minDepth = std::min(v0.depth, std::min(v1.depth, v2.depth));
+
+		// Attribute planes, so per pixel interpolation does not need the vertices anymore
+		triangle.depth = CreateAttributePlane(v0.depth, v1.depth, v2.depth);
+		triangle.invW = CreateAttributePlane(v0.invW, v1.invW, v2.invW);
+		triangle.texcoord = CreateAttributePlane(v0.texcoord * v0.invW, v1.texcoord * v1.invW, v2.texcoord * v2.invW);
+		triangle.normal = CreateAttributePlane(v0.normal * v0.invW, v1.normal * v1.invW, v2.normal * v2.invW);
+		triangle.tangent = CreateAttributePlane(v0.tangent * v0.invW, v1.tangent * v1.invW, v2.tangent * v2.invW);
+		triangle.worldPosition = CreateAttributePlane(v0.worldPosition * v0.invW, v1.worldPosition * v1.invW, v2.worldPosition * v2.invW);
+
+		//Bounding boxes logic - only loop over pixel centers within the smallest possible bounding box
+		int const minFixedX{ std::min(vert0.x, std::min(vert1.x, vert2.x)) };
+		int const minFixedY{ std::min(vert0.y, std::min(vert1.y, vert2.y)) };
+		int const maxFixedX{ std::max(vert0.x, std::max(vert1.x, vert2.x)) };
+		int const maxFixedY{ std::max(vert0.y, std::max(vert1.y, vert2.y)) };
+
+		// prevent looping over something off-screen. With MSAA a pixel is touched as soon as one of its samples is covered
+		int constexpr halfPixel{ SUBPIXEL_STEPS / 2 };
+		int const reach{ frame.isMSAAEnabled ? MSAA_SAMPLE_REACH : 0 };
+		triangle.minX = std::clamp((minFixedX - halfPixel - reach + SUBPIXEL_STEPS - 1) >> SUBPIXEL_BITS, 0, m_RenderWidth);
+		triangle.minY = std::clamp((minFixedY - halfPixel - reach + SUBPIXEL_STEPS - 1) >> SUBPIXEL_BITS, 0, m_RenderHeight);
+		triangle.maxX = std::clamp(((maxFixedX - halfPixel + reach) >> SUBPIXEL_BITS) + 1, 0, m_RenderWidth);
+		triangle.maxY = std::clamp(((maxFixedY - halfPixel + reach) >> SUBPIXEL_BITS) + 1, 0, m_RenderHeight);
+
+		if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
 		{
-			for (int py{ static_cast<int>(topLeft.y) }; py < static_cast<int>(topRight.y); ++py)
-			{
-				ColorRGB finalColor{ colors::White };
+			return false;
+		}
 
-				if (m_ShowBoundingBoxes)
-				{
-					m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-						static_cast<uint8_t>(finalColor.r * 255),
-						static_cast<uint8_t>(finalColor.g * 255),
-						static_cast<uint8_t>(finalColor.b * 255));
+		int const width{ triangle.maxX - triangle.minX };
+		int const height{ triangle.maxY - triangle.minY };
+		if (width <= TINY_TRIANGLE_SIZE && height <= TINY_TRIANGLE_SIZE)
+		{
+			triangle.rasterMethod = RasterMethod::Tiny;
+			return true;
+		}
 
-					continue;
+		// The SIMD kernels walk whole 8x8 blocks (or chunks), so they also evaluate lanes up to a block outside of the bounding box.
+		// The edge functions have to stay within 32 bits there, they are linear so checking the corners of that area is enough.
+		bool fitsInLanes{ true };
+		for (EdgeFunction const& edge : triangle.edges)
+		{
+			for (int const x : { triangle.minX - HIZ_BLOCK_SIZE, triangle.maxX + HIZ_BLOCK_SIZE })
+			{
+				for (int const y : { triangle.minY, triangle.maxY })
+				{
+					int64_t const e{ edge.Evaluate(x, y) };
+					fitsInLanes &= e > INT32_MIN && e < INT32_MAX;
 				}
+			}
+		}
 
-				Vector2 const pixel{ static_cast<float>(px) + .5f, static_cast<float>(py) + .5f };
-
-				//Calculate barycentric coordinates
-				float weight0{ Vector2::Cross((pixel - vert1), (vert1 - vert2)) * invTotalTriangleArea };
-				float weight1{ Vector2::Cross((pixel - vert2), (vert2 - vert0)) * invTotalTriangleArea };
-				float weight2{ Vector2::Cross((pixel - vert0), (vert0 - vert1)) * invTotalTriangleArea };
-
-				// Not in triangle
-				if (weight0 < 0.f || weight1 < 0.f || weight2 < 0.f)
+		if (!fitsInLanes)
+		{
+			triangle.rasterMethod = RasterMethod::Scalar;
+		}
+		else if (width >= SPAN_TRIANGLE_SIZE && height >= SPAN_TRIANGLE_SIZE)
+		{
+			triangle.rasterMethod = RasterMethod::Span;
+		}
+		else
+		{
+			triangle.rasterMethod = RasterMethod::Block;
+		}
+		return true;
+	}
+
+	void Renderer::ClipTriangle(Mesh const* m, TriangleSetup const& triangle, SoftwareFrame& frame) const
+	{
+		auto const& input{ m->GetVertexInput() };
+		auto const& output{ m->GetVertexOutput() };
+		Vertex_Out polygon[Utils::MAX_CLIPPED_VERTICES]{ output.GetVertex(input, triangle.vertexIndices[0]), output.GetVertex(input, triangle.vertexIndices[1]), output.GetVertex(input, triangle.vertexIndices[2]) };
+		int const count{ Utils::ClipPolygon(polygon, 3, triangle.clipPlanes) };
+		if (count < 3)
+		{
+			return;
+		}
+
+		// The clipped polygon is convex, split it up in a fan. The winding stays the same so culling still works
+		ProjectedVertex const first{ ProjectVertex(polygon[0]) };
+		for (int i{ 1 }; i < count - 1; ++i)
+		{
+			TriangleSetup clippedTriangle{};
+			if (SetupTriangle(m, first, ProjectVertex(polygon[i]), ProjectVertex(polygon[i + 1]), clippedTriangle, frame))
+			{
+				frame.triangles.push_back(clippedTriangle);
+			}
+		}
+	}
+
+	void Renderer::BinTriangles(SoftwareFrame& frame) const
+	{
+		// Tiles past the render resolution end up empty
+		for (auto& tile : frame.tiles)
+		{
+			tile.maxX = std::max(std::min(tile.minX + TILE_SIZE, frame.renderWidth), tile.minX);
+			tile.maxY = std::max(std::min(tile.minY + TILE_SIZE, frame.renderHeight), tile.minY);
+			tile.triangles.clear();
+			tile.transparentTriangles.clear();
+			tile.shadedFragments = 0;
+		}
+		std::fill(std::begin(frame.rasterMethodCounts), std::end(frame.rasterMethodCounts), 0);
+		frame.transparentTriangles.clear();
+		frame.sortKeys.clear();
+
+		auto const binTriangle = [this, &frame](uint32_t t, bool isTransparent)
+			{
+				TriangleSetup const& triangle{ frame.triangles[t] };
+				int const firstTileX{ triangle.minX / TILE_SIZE };
+				int const firstTileY{ triangle.minY / TILE_SIZE };
+				int const lastTileX{ (triangle.maxX - 1) / TILE_SIZE };
+				int const lastTileY{ (triangle.maxY - 1) / TILE_SIZE };
+
+				for (int ty{ firstTileY }; ty <= lastTileY; ++ty)
+				{
+					for (int tx{ firstTileX }; tx <= lastTileX; ++tx)
+					{
+						Tile& tile{ frame.tiles[tx + ty * m_NumTilesX] };
+						(isTransparent ? tile.transparentTriangles : tile.triangles).push_back(t);
+					}
+				}
+			};
+
+		// Done serially so every bin keeps the submission order, this keeps the result deterministic
+		for (uint32_t t{ 0 }; t < static_cast<uint32_t>(frame.triangles.size()); ++t)
+		{
+			TriangleSetup const& triangle{ frame.triangles[t] };
+			if (!triangle.pMesh)
+			{
+				continue;
+			}
+			++frame.rasterMethodCounts[static_cast<size_t>(triangle.rasterMethod)];
+
+			if (!IsTransparent(triangle.pMesh))
+			{
+				binTriangle(t, false);
+				continue;
+			}
+
+			// Depth at the centroid, in [0, 1] so the bits of the float sort like the float itself.
+			// Inverted, the furthest triangle has to come first.
+			float const depth{ std::clamp(triangle.depth.Interpolate(1.f / 3.f, 1.f / 3.f), 0.f, 1.f) };
+			frame.sortKeys.push_back(~std::bit_cast<uint32_t>(depth));
+			frame.transparentTriangles.push_back(t);
+		}
+
+		// Back to front, the sort is stable so triangles at the same depth keep their submission order
+		Utils::RadixSort(frame.sortKeys, frame.transparentTriangles, frame.sortScratch[0], frame.sortScratch[1]);
+		for (uint32_t const t : frame.transparentTriangles)
+		{
+			binTriangle(t, true);
+		}
+	}
+
+	void Renderer::RenderTile(Tile const& tile) const
+	{
+		SoftwareFrame const& frame{ m_Frames[m_RasterFrameIdx] };
+		auto const& triangles{ frame.triangles };
+		if (m_CurrRenderPath == RenderPath::ZPrepass)
+		{
+			// Fill the depth buffer of the tile first, so the shading pass knows which fragments end up visible
+			for (uint32_t const t : tile.triangles)
+			{
+				RenderTriangle(triangles[t], tile, RasterPass::DepthOnly);
+			}
+			for (uint32_t const t : tile.triangles)
+			{
+				RenderTriangle(triangles[t], tile, RasterPass::ShadeEqualDepth);
+			}
+		}
+		else
+		{
+			for (uint32_t const t : tile.triangles)
+			{
+				RenderTriangle(triangles[t], tile, RasterPass::DepthAndShade);
+			}
+
+			// The tile is fully rasterized, so the visibility buffer holds the final triangle of every pixel.
+			// MSAA shades while rasterizing (like forward), the visibility buffer only has room for one triangle per pixel.
+			if (m_CurrRenderPath == RenderPath::VisibilityBuffer && !frame.isMSAAEnabled)
+			{
+				ShadeVisibilityBuffer(tile);
+			}
+		}
+
+		// Transparent pass, back to front over the finished opaque tile. The depth buffer view only shows opaque depth.
+		if (!m_ShowDepthBuffer)
+		{
+			for (uint32_t const t : tile.transparentTriangles)
+			{
+				RenderTriangle(triangles[t], tile, RasterPass::Blend);
+			}
+		}
+	}
+
+	void Renderer::RenderTriangle(TriangleSetup const& triangle, Tile const& tile, RasterPass pass) const
+	{
+		bool const isMSAAEnabled{ m_Frames[m_RasterFrameIdx].isMSAAEnabled };
+
+		//Only loop over the part of the bounding box that lies inside this tile
+		int const minX{ std::max(triangle.minX, tile.minX) };
+		int const minY{ std::max(triangle.minY, tile.minY) };
+		int const maxX{ std::min(triangle.maxX, tile.maxX) };
+		int const maxY{ std::min(triangle.maxY, tile.maxY) };
+
+		if (m_ShowBoundingBoxes)
+		{
+			uint32_t const color{ SDL_MapRGB(m_pBackBuffer->format, 255, 255, 255) };
+			uint32_t* const pPixels{ isMSAAEnabled ? m_pSampleColors : m_pBackBufferPixels };
+			for (int s{ 0 }; s < (isMSAAEnabled ? MSAA_SAMPLES : 1); ++s)
+			{
+				uint32_t* const pPlane{ pPixels + s * m_Width * m_Height };
+				for (int py{ minY }; py < maxY; ++py)
+				{
+					std::fill(pPlane + minX + py * m_Width, pPlane + maxX + py * m_Width, color);
+				}
+			}
+			return;
+		}
+
+		switch (triangle.rasterMethod)
+		{
+		case RasterMethod::Tiny:
+			RenderTriangleTiny(triangle, minX, minY, maxX, maxY, pass);
+			return;
+		case RasterMethod::Scalar:
+			RenderTriangleScalar(triangle, minX, minY, maxX, maxY, pass);
+			return;
+		default:
+			break;
+		}
+
+		EdgeFunction const& edge0{ triangle.edges[0] };
+		EdgeFunction const& edge1{ triangle.edges[1] };
+		EdgeFunction const& edge2{ triangle.edges[2] };
+
+		simd::Float const depthBase{ simd::SetFloat(triangle.depth.base) };
+		simd::Float const depthD1{ simd::SetFloat(triangle.depth.d1) };
+		simd::Float const depthD2{ simd::SetFloat(triangle.depth.d2) };
+		simd::Float const remainder1{ simd::SetFloat(edge1.remainder) };
+		simd::Float const remainder2{ simd::SetFloat(edge2.remainder) };
+		simd::Float const invArea{ simd::SetFloat(triangle.invArea) };
+		simd::Float const zero{ simd::SetFloat(0.f) };
+		simd::Float const one{ simd::SetFloat(1.f) };
+
+		// Stepping one chunk to the right
+		simd::Int const step0{ simd::SetInt(static_cast<int>(edge0.stepX * simd::WIDTH)) };
+		simd::Int const step1{ simd::SetInt(static_cast<int>(edge1.stepX * simd::WIDTH)) };
+		simd::Int const step2{ simd::SetInt(static_cast<int>(edge2.stepX * simd::WIDTH)) };
+		simd::Int const stepPixels{ simd::SetInt(simd::WIDTH) };
+		simd::Int const minusOne{ simd::SetInt(-1) };
+		uint32_t const triangleIdx{ GetTriangleIdx(triangle) };
+		simd::Int const triangleIdxs{ simd::SetInt(static_cast<int>(triangleIdx)) };
+
+		alignas(32) float weights1[simd::WIDTH];
+		alignas(32) float weights2[simd::WIDTH];
+		alignas(32) float depths[simd::WIDTH];
+
+		bool const writesDepth{ pass == RasterPass::DepthAndShade || pass == RasterPass::DepthOnly };
+
+		// Depth test and shading of the covered lanes (mask) of one chunk, e1 and e2 hold the edge values of the chunk
+		auto const rasterizeChunk = [&](int px, int py, int blockIdx, simd::Int mask, simd::Int e1, simd::Int e2)
+			{
+				//Calculate barycentric coordinates, weight0 is not needed for the attribute planes
+				simd::Float const weight1{ simd::Mul(simd::Add(simd::ToFloat(e1), remainder1), invArea) };
+				simd::Float const weight2{ simd::Mul(simd::Add(simd::ToFloat(e2), remainder2), invArea) };
+
+				simd::Float const interpolatedDepth{ simd::Add(depthBase, simd::Add(simd::Mul(weight1, depthD1), simd::Mul(weight2, depthD2))) };
+
+				// Depth test, everything outside of [0, 1] gets clipped
+				float* const pDepth{ m_pDepthBufferPixels + px + py * m_Width };
+				mask = simd::And(mask, simd::And(simd::LessEqual(zero, interpolatedDepth), simd::LessEqual(interpolatedDepth, one)));
+				simd::Float const storedDepth{ simd::LoadMasked(pDepth, mask) };
+				if (pass == RasterPass::ShadeEqualDepth)
+				{
+					// Same setup and same math as the depth pass, so the visible fragment reproduces the stored depth exactly
+					mask = simd::And(mask, simd::Equal(interpolatedDepth, storedDepth));
+				}
+				else if (pass == RasterPass::Blend)
+				{
+					mask = simd::And(mask, simd::Less(interpolatedDepth, storedDepth));
+				}
+				else
+				{
+					mask = simd::And(mask, simd::LessEqual(interpolatedDepth, storedDepth));
+				}
+
+				uint32_t bits{ simd::MoveMask(mask) };
+				if (bits == 0)
+					return;
+
+				if (writesDepth)
+				{
+					simd::StoreMasked(pDepth, mask, interpolatedDepth);
+					m_pHiZDirty[blockIdx] = true;
+				}
+				if (pass == RasterPass::DepthOnly)
+				{
+					simd::StoreMasked(m_pDepthOwners + px + py * m_Width, mask, triangleIdxs);
+					return;
+				}
+
+				// Shading is still done one pixel at a time
+				simd::Store(weights1, weight1);
+				simd::Store(weights2, weight2);
+				simd::Store(depths, interpolatedDepth);
+				for (; bits != 0; bits &= bits - 1)
+				{
+					int const lane{ std::countr_zero(bits) };
+					if (pass == RasterPass::Blend)
+					{
+						BlendPixel(triangle, px + lane, py, weights1[lane], weights2[lane]);
+						continue;
+					}
+					if (pass == RasterPass::ShadeEqualDepth && m_pDepthOwners[px + lane + py * m_Width] != triangleIdx)
+					{
+						continue;
+					}
+					WriteFragment(triangle, px + lane, py, weights1[lane], weights2[lane], depths[lane]);
+				}
+			};
+
+		// MSAA version: coverage and depth per sample, then shading once per pixel for all of the samples that passed
+		SampleDeltas const deltas{ isMSAAEnabled ? CreateSampleDeltas(triangle) : SampleDeltas{} };
+		simd::Int sampleOffsets[3][MSAA_SAMPLES];
+		for (int i{ 0 }; i < 3 && isMSAAEnabled; ++i)
+		{
+			for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+			{
+				sampleOffsets[i][s] = simd::SetInt(triangle.edges[i].sampleOffsets[s]);
+			}
+		}
+		int const planeSize{ m_Width * m_Height };
+
+		auto const rasterizeChunkMSAA = [&](int px, int py, int blockIdx, simd::Int rangeMask, simd::Int e0, simd::Int e1, simd::Int e2)
+			{
+				// Coverage first, most chunks the walkers visit have no covered sample at all
+				simd::Int coverage[MSAA_SAMPLES];
+				simd::Int anyCoverage{ simd::SetInt(0) };
+				for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+				{
+					coverage[s] = simd::And(simd::Greater(simd::Or(simd::Or(simd::Add(e0, sampleOffsets[0][s]), simd::Add(e1, sampleOffsets[1][s])), simd::Add(e2, sampleOffsets[2][s])), minusOne), rangeMask);
+					anyCoverage = simd::Or(anyCoverage, coverage[s]);
+				}
+				if (simd::MoveMask(anyCoverage) == 0)
+					return;
+
+				simd::Float const weight1{ simd::Mul(simd::Add(simd::ToFloat(e1), remainder1), invArea) };
+				simd::Float const weight2{ simd::Mul(simd::Add(simd::ToFloat(e2), remainder2), invArea) };
+				simd::Float const centerDepth{ simd::Add(depthBase, simd::Add(simd::Mul(weight1, depthD1), simd::Mul(weight2, depthD2))) };
+
+				uint32_t sampleBits[MSAA_SAMPLES]{};
+				uint32_t pixelBits{ 0 };
+				simd::Int passed{ simd::SetInt(0) };
+				for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+				{
+					simd::Int mask{ coverage[s] };
+					if (simd::MoveMask(mask) == 0)
+						continue;
+
+					simd::Float const sampleDepth{ simd::Add(centerDepth, simd::SetFloat(deltas.depth[s])) };
+					float* const pDepth{ m_pSampleDepths + s * planeSize + px + py * m_Width };
+					mask = simd::And(mask, simd::And(simd::LessEqual(zero, sampleDepth), simd::LessEqual(sampleDepth, one)));
+					simd::Float const storedDepth{ simd::LoadMasked(pDepth, mask) };
+					uint32_t* const pOwners{ m_pSampleOwners + s * planeSize + px + py * m_Width };
+					if (pass == RasterPass::ShadeEqualDepth)
+					{
+						mask = simd::And(mask, simd::Equal(sampleDepth, storedDepth));
+					}
+					else if (pass == RasterPass::Blend)
+					{
+						mask = simd::And(mask, simd::Less(sampleDepth, storedDepth));
+					}
+					else
+					{
+						mask = simd::And(mask, simd::LessEqual(sampleDepth, storedDepth));
+						simd::StoreMasked(pDepth, mask, sampleDepth);
+						if (pass == RasterPass::DepthOnly)
+						{
+							simd::StoreMasked(pOwners, mask, triangleIdxs);
+						}
+					}
+
+					sampleBits[s] = simd::MoveMask(mask);
+					if (pass == RasterPass::ShadeEqualDepth)
+					{
+						for (uint32_t bits{ sampleBits[s] }; bits != 0; bits &= bits - 1)
+						{
+							int const lane{ std::countr_zero(bits) };
+							if (pOwners[lane] != triangleIdx)
+							{
+								sampleBits[s] &= ~(1u << lane);
+							}
+						}
+					}
+					pixelBits |= sampleBits[s];
+					passed = simd::Or(passed, mask);
+				}
+
+				if (pixelBits == 0)
+					return;
+				if (writesDepth)
+				{
+					// The depth buffer holds the furthest sample of every pixel, so the hierarchical depth only has to look at one plane
+					int const pixelIdx{ px + py * m_Width };
+					simd::Float maxDepth{ simd::LoadMasked(m_pSampleDepths + pixelIdx, passed) };
+					for (int s{ 1 }; s < MSAA_SAMPLES; ++s)
+					{
+						maxDepth = simd::Max(maxDepth, simd::LoadMasked(m_pSampleDepths + s * planeSize + pixelIdx, passed));
+					}
+					simd::StoreMasked(m_pDepthBufferPixels + pixelIdx, passed, maxDepth);
+					m_pHiZDirty[blockIdx] = true;
+				}
+				if (pass == RasterPass::DepthOnly)
+					return;
+
+				uint32_t const centerBits{ simd::MoveMask(simd::Greater(simd::Or(simd::Or(e0, e1), e2), minusOne)) };
+				simd::Store(weights1, weight1);
+				simd::Store(weights2, weight2);
+				simd::Store(depths, centerDepth);
+				for (; pixelBits != 0; pixelBits &= pixelBits - 1)
+				{
+					int const lane{ std::countr_zero(pixelBits) };
+					uint32_t const laneBit{ 1u << lane };
+
+					// Shade at the center, or at the first sample that passed when the center is outside of the triangle (centroid)
+					float w1{ weights1[lane] };
+					float w2{ weights2[lane] };
+					float depth{ depths[lane] };
+					if (!(centerBits & laneBit))
+					{
+						int s{ 0 };
+						while (!(sampleBits[s] & laneBit))
+						{
+							++s;
+						}
+						w1 += deltas.weight1[s];
+						w2 += deltas.weight2[s];
+						depth += deltas.depth[s];
+					}
+
+					uint32_t alpha{ 256 };
+					uint32_t const color{ pass == RasterPass::Blend ? ShadeTransparentFragment(triangle, px + lane, py, w1, w2, alpha) : ShadeFragment(triangle, px + lane, py, w1, w2, depth) };
+					for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+					{
+						if (sampleBits[s] & laneBit)
+						{
+							uint32_t& sampleColor{ m_pSampleColors[s * planeSize + px + lane + py * m_Width] };
+							sampleColor = pass == RasterPass::Blend ? LerpPackedColor(sampleColor, color, alpha) : color;
+						}
+					}
+				}
+			};
+
+		if (triangle.rasterMethod == RasterMethod::Span)
+		{
+			// Every row only covers one span, solve the three edge functions for its first and last pixel center:
+			// E(px) = stepX * px + E(0) >= 0, a lower bound for a positive step and an upper bound for a negative one
+			auto const floorDiv = [](int64_t a, int64_t b)
+				{
+					int64_t const q{ a / b };
+					return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+				};
+
+			// Hierarchical depth state of the blocks of the current block row: unknown, visible or hidden.
+			// Only tested once per block, rows further down the block reuse it.
+			enum class BlockState : uint8_t { Unknown, Visible, Hidden };
+			BlockState blockStates[TILE_SIZE / HIZ_BLOCK_SIZE]{};
+
+			for (int py{ minY }; py < maxY; ++py)
+			{
+				if (py == minY || py % HIZ_BLOCK_SIZE == 0)
+				{
+					std::fill(std::begin(blockStates), std::end(blockStates), BlockState::Unknown);
+				}
+
+				int64_t spanMinX{ minX };
+				int64_t spanMaxX{ maxX };
+				for (EdgeFunction const& edge : triangle.edges)
+				{
+					int64_t const rowStart{ edge.Evaluate(0, py) };
+					if (edge.stepX > 0)
+					{
+						spanMinX = std::max(spanMinX, -floorDiv(rowStart, edge.stepX));
+					}
+					else if (edge.stepX < 0)
+					{
+						spanMaxX = std::min(spanMaxX, floorDiv(rowStart, -edge.stepX) + 1);
+					}
+					else if (rowStart < 0)
+					{
+						spanMaxX = spanMinX;
+					}
+				}
+				if (isMSAAEnabled)
+				{
+					// Samples lie within a pixel of the center, the span of pixels with a covered sample is at most one wider on both sides
+					spanMinX = std::max(spanMinX - 1, int64_t{ minX });
+					spanMaxX = std::min(spanMaxX + 1, int64_t{ maxX });
+				}
+				if (spanMinX >= spanMaxX)
 					continue;
 
-				//Normalize weights
-				auto const totWeight = weight0 + weight1 + weight2;
-				weight0 /= totWeight;
-				weight1 /= totWeight;
-				weight2 /= totWeight;
+				// Chunks are aligned to simd::WIDTH so they never straddle two blocks
+				int const firstPx{ static_cast<int>(spanMinX) };
+				int const lastPx{ static_cast<int>(spanMaxX) };
+				int const startX{ firstPx - firstPx % simd::WIDTH };
+				simd::Int const firstX{ simd::SetInt(firstPx - 1) };
+				simd::Int const lastX{ simd::SetInt(lastPx) };
 
-				float const depth0{ m->GetVertices_Out()[idx1].position.z };
-				float const depth1{ m->GetVertices_Out()[idx2].position.z };
-				float const depth2{ m->GetVertices_Out()[idx3].position.z };
-				
-				float const interpolatedDepth{ 1.f / (weight0 * (1.f / depth0) + weight1 * (1.f / depth1) + weight2 * (1.f / depth2)) };
+				simd::Int e0{ simd::Ramp(static_cast<int>(edge0.Evaluate(startX, py)), static_cast<int>(edge0.stepX)) };
+				simd::Int e1{ simd::Ramp(static_cast<int>(edge1.Evaluate(startX, py)), static_cast<int>(edge1.stepX)) };
+				simd::Int e2{ simd::Ramp(static_cast<int>(edge2.Evaluate(startX, py)), static_cast<int>(edge2.stepX)) };
+				simd::Int x{ simd::Ramp(startX, 1) };
 
-				if (interpolatedDepth < 0.f || interpolatedDepth > 1.f || m_pDepthBufferPixels[px + py * m_Width] < interpolatedDepth)
+				for (int px{ startX }; px < lastPx; px += simd::WIDTH, e0 = simd::Add(e0, step0), e1 = simd::Add(e1, step1), e2 = simd::Add(e2, step2), x = simd::Add(x, stepPixels))
 				{
+					int const blockIdx{ px / HIZ_BLOCK_SIZE + (py / HIZ_BLOCK_SIZE) * m_HiZWidth };
+					BlockState& blockState{ blockStates[(px - tile.minX) / HIZ_BLOCK_SIZE] };
+					if (blockState == BlockState::Unknown)
+					{
+						// Every pixel in this block is already closer than anything this triangle could write
+						blockState = triangle.minDepth > GetBlockMaxDepth(blockIdx) ? BlockState::Hidden : BlockState::Visible;
+					}
+					if (blockState == BlockState::Hidden)
+						continue;
+
+					// The span is exact, so only the lanes outside of it have to be masked
+					simd::Int const rangeMask{ simd::And(simd::Greater(x, firstX), simd::Greater(lastX, x)) };
+					if (isMSAAEnabled)
+					{
+						rasterizeChunkMSAA(px, py, blockIdx, rangeMask, e0, e1, e2);
+						continue;
+					}
+					rasterizeChunk(px, py, blockIdx, rangeMask, e1, e2);
+				}
+			}
+			return;
+		}
+
+		simd::Int const firstX{ simd::SetInt(minX - 1) };
+		simd::Int const lastX{ simd::SetInt(maxX) };
+
+		// Walk the bounding box in 8x8 blocks (aligned to the screen, so also to the tiles) so a whole block can be rejected with the hierarchical depth buffer first
+		int const startX{ minX - minX % HIZ_BLOCK_SIZE };
+		int const startY{ minY - minY % HIZ_BLOCK_SIZE };
+
+		for (int blockY{ startY }; blockY < maxY; blockY += HIZ_BLOCK_SIZE)
+		{
+			for (int blockX{ startX }; blockX < maxX; blockX += HIZ_BLOCK_SIZE)
+			{
+				int const blockIdx{ blockX / HIZ_BLOCK_SIZE + (blockY / HIZ_BLOCK_SIZE) * m_HiZWidth };
+
+				// Every pixel in this block is already closer than anything this triangle could write
+				if (triangle.minDepth > GetBlockMaxDepth(blockIdx))
 					continue;
+
+				int const blockMaxX{ std::min(blockX + HIZ_BLOCK_SIZE, maxX) };
+				int const blockMaxY{ std::min(blockY + HIZ_BLOCK_SIZE, maxY) };
+				for (int py{ std::max(blockY, minY) }; py < blockMaxY; ++py)
+				{
+					// Evaluate the edge functions once per block row, after that every lane is stepped with a single add
+					simd::Int e0{ simd::Ramp(static_cast<int>(edge0.Evaluate(blockX, py)), static_cast<int>(edge0.stepX)) };
+					simd::Int e1{ simd::Ramp(static_cast<int>(edge1.Evaluate(blockX, py)), static_cast<int>(edge1.stepX)) };
+					simd::Int e2{ simd::Ramp(static_cast<int>(edge2.Evaluate(blockX, py)), static_cast<int>(edge2.stepX)) };
+					simd::Int x{ simd::Ramp(blockX, 1) };
+
+					for (int px{ blockX }; px < blockMaxX; px += simd::WIDTH, e0 = simd::Add(e0, step0), e1 = simd::Add(e1, step1), e2 = simd::Add(e2, step2), x = simd::Add(x, stepPixels))
+					{
+						// Inside all three edges and inside the part of the bounding box this tile owns
+						simd::Int const rangeMask{ simd::And(simd::Greater(x, firstX), simd::Greater(lastX, x)) };
+						if (isMSAAEnabled)
+						{
+							rasterizeChunkMSAA(px, py, blockIdx, rangeMask, e0, e1, e2);
+							continue;
+						}
+						simd::Int const mask{ simd::And(simd::Greater(simd::Or(simd::Or(e0, e1), e2), minusOne), rangeMask) };
+
+						if (simd::MoveMask(mask) == 0)
+							continue;
+
+						rasterizeChunk(px, py, blockIdx, mask, e1, e2);
+					}
 				}
-				m_pDepthBufferPixels[px + py * m_Width] = interpolatedDepth;
+			}
+		}
+	}
 
-				if (m_ShowDepthBuffer)
+	void Renderer::RenderTriangleTiny(TriangleSetup const& triangle, int minX, int minY, int maxX, int maxY, RasterPass pass) const
+	{
+		// At most 2x2 blocks, skip the triangle when all of them are already closer than anything it could write
+		bool isHidden{ true };
+		for (int blockY{ minY / HIZ_BLOCK_SIZE }; blockY <= (maxY - 1) / HIZ_BLOCK_SIZE && isHidden; ++blockY)
+		{
+			for (int blockX{ minX / HIZ_BLOCK_SIZE }; blockX <= (maxX - 1) / HIZ_BLOCK_SIZE && isHidden; ++blockX)
+			{
+				isHidden = triangle.minDepth > GetBlockMaxDepth(blockX + blockY * m_HiZWidth);
+			}
+		}
+		if (isHidden)
+		{
+			return;
+		}
+
+		// No more than TINY_TRIANGLE_SIZE^2 pixel centers, testing them directly is cheaper than setting up any SIMD stepping
+		RenderTriangleScalar(triangle, minX, minY, maxX, maxY, pass);
+	}
+
+	void Renderer::RenderTriangleScalar(TriangleSetup const& triangle, int minX, int minY, int maxX, int maxY, RasterPass pass) const
+	{
+		bool const isMSAAEnabled{ m_Frames[m_RasterFrameIdx].isMSAAEnabled };
+		EdgeFunction const& edge0{ triangle.edges[0] };
+		EdgeFunction const& edge1{ triangle.edges[1] };
+		EdgeFunction const& edge2{ triangle.edges[2] };
+		float const invTotalTriangleArea{ triangle.invArea };
+		SampleDeltas const deltas{ isMSAAEnabled ? CreateSampleDeltas(triangle) : SampleDeltas{} };
+
+		for (int py{ minY }; py < maxY; ++py)
+		{
+			int64_t e0{ edge0.Evaluate(minX, py) };
+			int64_t e1{ edge1.Evaluate(minX, py) };
+			int64_t e2{ edge2.Evaluate(minX, py) };
+
+			for (int px{ minX }; px < maxX; ++px, e0 += edge0.stepX, e1 += edge1.stepX, e2 += edge2.stepX)
+			{
+				if (isMSAAEnabled)
+				{
+					RenderPixelMSAA(triangle, deltas, px, py, { e0, e1, e2 }, pass);
+					continue;
+				}
+
+				// Not in triangle, one of the edge functions is negative
+				if ((e0 | e1 | e2) < 0)
+					continue;
+
+				//Calculate barycentric coordinates, weight0 is not needed for the attribute planes
+				float const weight1{ (static_cast<float>(e1) + edge1.remainder) * invTotalTriangleArea };
+				float const weight2{ (static_cast<float>(e2) + edge2.remainder) * invTotalTriangleArea };
+
+				float const interpolatedDepth{ triangle.depth.Interpolate(weight1, weight2) };
+
+				if (interpolatedDepth < 0.f || interpolatedDepth > 1.f)
+				{
+					continue;
+				}
+
+				float& storedDepth{ m_pDepthBufferPixels[px + py * m_Width] };
+				if (pass == RasterPass::ShadeEqualDepth)
+				{
+					if (storedDepth == interpolatedDepth && m_pDepthOwners[px + py * m_Width] == GetTriangleIdx(triangle))
+					{
+						WriteFragment(triangle, px, py, weight1, weight2, interpolatedDepth);
+					}
+					continue;
+				}
+				if (pass == RasterPass::Blend)
+				{
+					if (interpolatedDepth < storedDepth)
+					{
+						BlendPixel(triangle, px, py, weight1, weight2);
+					}
+					continue;
+				}
+
+				if (storedDepth < interpolatedDepth)
 				{
-					float const remap{ Utils::DepthRemap(interpolatedDepth, .985f, 1.f) };
-					finalColor = ColorRGB{ (1.f - remap) * 5,   (1.f - remap) * 5, 1.f };
+					continue;
+				}
+				storedDepth = interpolatedDepth;
+				m_pHiZDirty[px / HIZ_BLOCK_SIZE + (py / HIZ_BLOCK_SIZE) * m_HiZWidth] = true;
+
+				if (pass == RasterPass::DepthAndShade)
+				{
+					WriteFragment(triangle, px, py, weight1, weight2, interpolatedDepth);
 				}
-				else // Pixel shading
+				else if (pass == RasterPass::DepthOnly)
 				{
-					Vertex_Out pixelToShade{};
-					pixelToShade.position = { static_cast<float>(px), static_cast<float>(py), interpolatedDepth,interpolatedDepth };
+					m_pDepthOwners[px + py * m_Width] = GetTriangleIdx(triangle);
+				}
+			}
+		}
+	}
+
+	void Renderer::RenderPixelMSAA(TriangleSetup const& triangle, SampleDeltas const& deltas, int px, int py, int64_t const (&edges)[3], RasterPass pass) const
+	{
+		float const weight1{ (static_cast<float>(edges[1]) + triangle.edges[1].remainder) * triangle.invArea };
+		float const weight2{ (static_cast<float>(edges[2]) + triangle.edges[2].remainder) * triangle.invArea };
+		float const centerDepth{ triangle.depth.Interpolate(weight1, weight2) };
+		int const pixelIdx{ px + py * m_Width };
+
+		bool const writesDepth{ pass == RasterPass::DepthAndShade || pass == RasterPass::DepthOnly };
+		uint32_t sampleBits{ 0 };
+		for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+		{
+			if (((edges[0] + triangle.edges[0].sampleOffsets[s]) | (edges[1] + triangle.edges[1].sampleOffsets[s]) | (edges[2] + triangle.edges[2].sampleOffsets[s])) < 0)
+				continue;
+
+			float const sampleDepth{ centerDepth + deltas.depth[s] };
+			if (sampleDepth < 0.f || sampleDepth > 1.f)
+				continue;
+
+			float& storedDepth{ m_pSampleDepths[s * m_Width * m_Height + pixelIdx] };
+			uint32_t& owner{ m_pSampleOwners[s * m_Width * m_Height + pixelIdx] };
+			if (pass == RasterPass::ShadeEqualDepth ? storedDepth != sampleDepth || owner != GetTriangleIdx(triangle) : pass == RasterPass::Blend ? storedDepth <= sampleDepth : storedDepth < sampleDepth)
+				continue;
+
+			if (writesDepth)
+			{
+				storedDepth = sampleDepth;
+			}
+			if (pass == RasterPass::DepthOnly)
+			{
+				owner = GetTriangleIdx(triangle);
+			}
+			sampleBits |= 1u << s;
+		}
 
+		if (sampleBits == 0)
+			return;
+		if (writesDepth)
+		{
+			// The depth buffer holds the furthest sample of every pixel, so the hierarchical depth only has to look at one plane
+			float maxDepth{ 0.f };
+			for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+			{
+				maxDepth = std::max(maxDepth, m_pSampleDepths[s * m_Width * m_Height + pixelIdx]);
+			}
+			m_pDepthBufferPixels[pixelIdx] = maxDepth;
+			m_pHiZDirty[px / HIZ_BLOCK_SIZE + (py / HIZ_BLOCK_SIZE) * m_HiZWidth] = true;
+		}
+		if (pass == RasterPass::DepthOnly)
+			return;
 
-					//Calculate viewdirection
-					Vector3 const viewDir{ (m->GetWorldMatrix().TransformPoint((weight0 * m->GetVertices()[idx1].position 
-																				+ weight1 * m->GetVertices()[idx2].position 
-																				+ weight2 * m->GetVertices()[idx3].position)) - m_Camera.origin).Normalized() };
+		// Shade at the center, or at the first sample that passed when the center is outside of the triangle (centroid)
+		float shadeWeight1{ weight1 };
+		float shadeWeight2{ weight2 };
+		float shadeDepth{ centerDepth };
+		if ((edges[0] | edges[1] | edges[2]) < 0)
+		{
+			int const s{ std::countr_zero(sampleBits) };
+			shadeWeight1 += deltas.weight1[s];
+			shadeWeight2 += deltas.weight2[s];
+			shadeDepth += deltas.depth[s];
+		}
+		uint32_t alpha{ 256 };
+		uint32_t const color{ pass == RasterPass::Blend ? ShadeTransparentFragment(triangle, px, py, shadeWeight1, shadeWeight2, alpha) : ShadeFragment(triangle, px, py, shadeWeight1, shadeWeight2, shadeDepth) };
+
+		for (; sampleBits != 0; sampleBits &= sampleBits - 1)
+		{
+			uint32_t& sampleColor{ m_pSampleColors[std::countr_zero(sampleBits) * m_Width * m_Height + pixelIdx] };
+			sampleColor = pass == RasterPass::Blend ? LerpPackedColor(sampleColor, color, alpha) : color;
+		}
+	}
 
-					pixelToShade.texcoord = interpolatedDepth * ((weight0 * m->GetVertices()[idx1].texcoord) / depth0
-																+ (weight1 * m->GetVertices()[idx2].texcoord) / depth1
-																+ (weight2 * m->GetVertices()[idx3].texcoord) / depth2);
-					pixelToShade.normal = Vector3{ interpolatedDepth * (weight0 * m->GetVertices_Out()[idx1].normal / m->GetVertices_Out()[idx1].position.w
-																	  + weight1 * m->GetVertices_Out()[idx2].normal / m->GetVertices_Out()[idx2].position.w 
-																	  + weight2 * m->GetVertices_Out()[idx3].normal / m->GetVertices_Out()[idx3].position.w) }.Normalized();
-					pixelToShade.tangent = Vector3{ interpolatedDepth * (weight0 * m->GetVertices_Out()[idx1].tangent / m->GetVertices_Out()[idx1].position.w 
-																		+ weight1 * m->GetVertices_Out()[idx2].tangent / m->GetVertices_Out()[idx2].position.w 
-																		+ weight2 * m->GetVertices_Out()[idx3].tangent / m->GetVertices_Out()[idx3].position.w) }.Normalized();
+	void Renderer::CreateMSAABuffers()
+	{
+		// 48 bytes per pixel, so only once MSAA gets used. They cover the whole window, dynamic resolution renders into a part of them.
+		if (m_pSampleDepths)
+		{
+			return;
+		}
+		m_pSampleDepths = new float[MSAA_SAMPLES * m_Width * m_Height];
+		m_pSampleColors = new uint32_t[MSAA_SAMPLES * m_Width * m_Height];
+		m_pSampleOwners = new uint32_t[MSAA_SAMPLES * m_Width * m_Height];
+	}
 
+	void Renderer::ResolveTile(Tile const& tile) const
+	{
+		// Average of the samples per 8 bit channel. Every other channel is summed in its own 16 bits, so 4 samples can't overflow into the next one
+		int const planeSize{ m_Width * m_Height };
+		simd::Int const channelMask{ simd::SetInt(0x00FF00FF) };
+		simd::Int const rounding{ simd::SetInt(0x00020002) };
+		static_assert(MSAA_SAMPLES == 4, "The resolve divides by shifting");
 
-					finalColor = PixelShading(m, pixelToShade, viewDir);
+		for (int py{ tile.minY }; py < tile.maxY; ++py)
+		{
+			int px{ tile.minX };
+			for (; px + simd::WIDTH <= tile.maxX; px += simd::WIDTH)
+			{
+				int const pixelIdx{ px + py * m_Width };
+				simd::Int evenChannels{ simd::SetInt(0) };
+				simd::Int oddChannels{ simd::SetInt(0) };
+				for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+				{
+					simd::Int const color{ simd::Load(m_pSampleColors + s * planeSize + pixelIdx) };
+					evenChannels = simd::Add(evenChannels, simd::And(color, channelMask));
+					oddChannels = simd::Add(oddChannels, simd::And(simd::ShiftRight<8>(color), channelMask));
 				}
+				evenChannels = simd::And(simd::ShiftRight<2>(simd::Add(evenChannels, rounding)), channelMask);
+				oddChannels = simd::ShiftLeft<8>(simd::And(simd::ShiftRight<2>(simd::Add(oddChannels, rounding)), channelMask));
+				simd::Store(m_pBackBufferPixels + pixelIdx, simd::Or(evenChannels, oddChannels));
+			}
 
+			// Tiles at the right edge of a screen that is not a multiple of simd::WIDTH wide
+			for (; px < tile.maxX; ++px)
+			{
+				int const pixelIdx{ px + py * m_Width };
+				uint32_t evenChannels{ 0 };
+				uint32_t oddChannels{ 0 };
+				for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+				{
+					uint32_t const color{ m_pSampleColors[s * planeSize + pixelIdx] };
+					evenChannels += color & 0x00FF00FF;
+					oddChannels += (color >> 8) & 0x00FF00FF;
+				}
+				m_pBackBufferPixels[pixelIdx] = (((evenChannels + 0x00020002) >> 2) & 0x00FF00FF) | ((((oddChannels + 0x00020002) >> 2) & 0x00FF00FF) << 8);
+			}
+		}
+	}
 
-				//Update Color in Buffer
-				finalColor.MaxToOne();
-				m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255));
+	void Renderer::ResetCoarseShades(Tile const& tile) const
+	{
+		// Triangle indices are reused every frame, so the coarse pixels of the last frame can not be trusted
+		for (int ry{ tile.minY / RATE_TILE_SIZE }; ry * RATE_TILE_SIZE < tile.maxY; ++ry)
+		{
+			for (int rx{ tile.minX / RATE_TILE_SIZE }; rx * RATE_TILE_SIZE < tile.maxX; ++rx)
+			{
+				int const rateTileIdx{ rx + ry * m_NumRateTilesX };
+				ShadingRate const rate{ m_pShadingRates[rateTileIdx] };
+				if (rate != ShadingRate::Rate1x1)
+				{
+					int const numCoarsePixels{ RATE_TILE_SIZE * RATE_TILE_SIZE / (GetShadingRateWidth(rate) * GetShadingRateHeight(rate)) };
+					std::fill_n(m_pCoarseShades + rateTileIdx * MAX_COARSE_PIXELS_PER_RATE_TILE, numCoarsePixels, CoarseShade{});
+				}
 			}
 		}
 	}
 
-	ColorRGB Renderer::PixelShading(Mesh const* m, Vertex_Out const& v, Vector3 const& viewDir) const
+	void Renderer::UpdateShadingRates(Tile const& tile) const
+	{
+		SDL_PixelFormat const* const pFormat{ m_pBackBuffer->format };
+		auto const getLuminance = [pFormat](uint32_t color)
+			{
+				// Rec. 709 weights, out of 256
+				uint32_t const r{ (color >> pFormat->Rshift) & 0xFF };
+				uint32_t const g{ (color >> pFormat->Gshift) & 0xFF };
+				uint32_t const b{ (color >> pFormat->Bshift) & 0xFF };
+				return static_cast<int>((54 * r + 183 * g + 19 * b) >> 8);
+			};
+
+		for (int ry{ tile.minY / RATE_TILE_SIZE }; ry * RATE_TILE_SIZE < tile.maxY; ++ry)
+		{
+			for (int rx{ tile.minX / RATE_TILE_SIZE }; rx * RATE_TILE_SIZE < tile.maxX; ++rx)
+			{
+				int const minX{ rx * RATE_TILE_SIZE };
+				int const minY{ ry * RATE_TILE_SIZE };
+				int const maxX{ std::min(minX + RATE_TILE_SIZE, tile.maxX) };
+				int const maxY{ std::min(minY + RATE_TILE_SIZE, tile.maxY) };
+
+				// Average luminance step between neighbouring pixels, along x and along y.
+				// Only pixels that got rendered count, the background and the silhouettes keep per pixel coverage anyway.
+				// Coarse pixels have no steps inside but bigger ones in between, so this hardly changes with the rate that was used.
+				int sumX{ 0 }, numX{ 0 }, sumY{ 0 }, numY{ 0 };
+				int sumLuminance{ 0 }, numPixels{ 0 };
+				for (int py{ minY }; py < maxY; ++py)
+				{
+					for (int px{ minX }; px < maxX; ++px)
+					{
+						int const pixelIdx{ px + py * m_Width };
+						if (m_pDepthBufferPixels[pixelIdx] == FLT_MAX)
+						{
+							continue;
+						}
+
+						int const luminance{ getLuminance(m_pBackBufferPixels[pixelIdx]) };
+						sumLuminance += luminance;
+						++numPixels;
+						if (px + 1 < maxX && m_pDepthBufferPixels[pixelIdx + 1] != FLT_MAX)
+						{
+							sumX += std::abs(getLuminance(m_pBackBufferPixels[pixelIdx + 1]) - luminance);
+							++numX;
+						}
+						if (py + 1 < maxY && m_pDepthBufferPixels[pixelIdx + m_Width] != FLT_MAX)
+						{
+							sumY += std::abs(getLuminance(m_pBackBufferPixels[pixelIdx + m_Width]) - luminance);
+							++numY;
+						}
+					}
+				}
+
+				// Nothing rendered: geometry that moves in next frame should not start out blurry
+				ShadingRate rate{ ShadingRate::Rate1x1 };
+				if (numX > 0 && numY > 0)
+				{
+					float const gradientX{ static_cast<float>(sumX) / static_cast<float>(numX) };
+					float const gradientY{ static_cast<float>(sumY) / static_cast<float>(numY) };
+					float const gradient{ std::max(gradientX, gradientY) };
+
+					// Weber's law: the same step is harder to see on a bright surface than on a dark one
+					float const meanLuminance{ static_cast<float>(sumLuminance) / static_cast<float>(numPixels) };
+					float const maxError{ VRS_SENSITIVITY * (meanLuminance + VRS_MIN_LUMINANCE) };
+
+					// The furthest pixel of a coarse pixel is (size - 1) steps away from the one that got shaded
+					if (gradient * 3.f <= maxError)
+					{
+						rate = ShadingRate::Rate4x4;
+					}
+					else if (gradient <= maxError)
+					{
+						rate = ShadingRate::Rate2x2;
+					}
+					else if (gradientY <= maxError)
+					{
+						rate = ShadingRate::Rate1x2;
+					}
+				}
+				m_pShadingRates[rx + ry * m_NumRateTilesX] = rate;
+			}
+		}
+	}
+
+	float Renderer::GetBlockMaxDepth(int blockIdx) const
+	{
+		if (!m_pHiZDirty[blockIdx])
+		{
+			return m_pHiZBuffer[blockIdx];
+		}
+
+		int const blockX{ (blockIdx % m_HiZWidth) * HIZ_BLOCK_SIZE };
+		int const blockY{ (blockIdx / m_HiZWidth) * HIZ_BLOCK_SIZE };
+		int const maxX{ std::min(blockX + HIZ_BLOCK_SIZE, m_Width) };
+		int const maxY{ std::min(blockY + HIZ_BLOCK_SIZE, m_Height) };
+
+		float maxDepth{ 0.f };
+		for (int py{ blockY }; py < maxY; ++py)
+		{
+			for (int px{ blockX }; px < maxX; ++px)
+			{
+				maxDepth = std::max(maxDepth, m_pDepthBufferPixels[px + py * m_Width]);
+			}
+		}
+
+		m_pHiZBuffer[blockIdx] = maxDepth;
+		m_pHiZDirty[blockIdx] = false;
+		return maxDepth;
+	}
+
+	void Renderer::WriteFragment(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, float interpolatedDepth) const
+	{
+		if (m_CurrRenderPath == RenderPath::VisibilityBuffer)
+		{
+			m_pVisibilityBuffer[px + py * m_Width] = { static_cast<uint32_t>(&triangle - m_Frames[m_RasterFrameIdx].triangles.data()), weight1, weight2 };
+			return;
+		}
+		ShadePixel(triangle, px, py, weight1, weight2, interpolatedDepth);
+	}
+
+	void Renderer::ShadeVisibilityBuffer(Tile const& tile) const
+	{
+		auto const& triangles{ m_Frames[m_RasterFrameIdx].triangles };
+		for (int py{ tile.minY }; py < tile.maxY; ++py)
+		{
+			for (int px{ tile.minX }; px < tile.maxX; ++px)
+			{
+				VisibilityTexel const& texel{ m_pVisibilityBuffer[px + py * m_Width] };
+				if (texel.triangleIdx == INVALID_TRIANGLE)
+					continue;
+
+				ShadePixel(triangles[texel.triangleIdx], px, py, texel.weight1, texel.weight2, m_pDepthBufferPixels[px + py * m_Width]);
+			}
+		}
+	}
+
+	void Renderer::ShadePixel(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, float interpolatedDepth) const
+	{
+		m_pBackBufferPixels[px + (py * m_Width)] = ShadeFragment(triangle, px, py, weight1, weight2, interpolatedDepth);
+	}
+
+	uint32_t Renderer::ShadeFragment(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, float interpolatedDepth) const
+	{
+		// Variable rate shading: the first fragment of a triangle in a coarse pixel gets shaded, the rest of that coarse pixel reuses its color.
+		// Every shading mode goes through here, so they all benefit.
+		CoarseShade* pCoarseShade{ nullptr };
+		ShadingRate rate{ ShadingRate::Rate1x1 };
+		if (m_IsVariableRateShading)
+		{
+			int const rateTileIdx{ px / RATE_TILE_SIZE + (py / RATE_TILE_SIZE) * m_NumRateTilesX };
+			rate = m_pShadingRates[rateTileIdx];
+			if (rate != ShadingRate::Rate1x1)
+			{
+				int const rateWidth{ GetShadingRateWidth(rate) };
+				int const coarseX{ (px % RATE_TILE_SIZE) / rateWidth };
+				int const coarseY{ (py % RATE_TILE_SIZE) / GetShadingRateHeight(rate) };
+				pCoarseShade = &m_pCoarseShades[rateTileIdx * MAX_COARSE_PIXELS_PER_RATE_TILE + coarseX + coarseY * (RATE_TILE_SIZE / rateWidth)];
+
+				auto const triangleIdx{ static_cast<uint32_t>(&triangle - m_Frames[m_RasterFrameIdx].triangles.data()) };
+				if (pCoarseShade->triangleIdx == triangleIdx)
+				{
+					return pCoarseShade->color;
+				}
+				pCoarseShade->triangleIdx = triangleIdx;
+			}
+		}
+
+		// Every tile is only shaded by one thread, so its counter needs no synchronization
+		++m_Frames[m_RasterFrameIdx].tiles[px / TILE_SIZE + (py / TILE_SIZE) * m_NumTilesX].shadedFragments;
+
+		Mesh const* m{ triangle.pMesh };
+		ColorRGB finalColor{ colors::White };
+
+		if (m_ShowDepthBuffer)
+		{
+			float const remap{ Utils::DepthRemap(interpolatedDepth, .985f, 1.f) };
+			finalColor = ColorRGB{ (1.f - remap) * 5,   (1.f - remap) * 5, 1.f };
+		}
+		else // Pixel shading
+		{
+			// The only reciprocal per pixel, turns the interpolated attribute/w values back into the attributes
+			float const w{ 1.f / triangle.invW.Interpolate(weight1, weight2) };
+
+			Vertex_Out pixelToShade{};
+			pixelToShade.position = { static_cast<float>(px), static_cast<float>(py), interpolatedDepth, w };
+			pixelToShade.worldPosition = triangle.worldPosition.Interpolate(weight1, weight2) * w;
+
+			//Calculate viewdirection
+			Vector3 const viewDir{ (pixelToShade.worldPosition - m_Frames[m_RasterFrameIdx].cameraOrigin).Normalized() };
+
+			pixelToShade.texcoord = triangle.texcoord.Interpolate(weight1, weight2) * w;
+			// Normalized anyway, so multiplying with w is not needed
+			pixelToShade.normal = triangle.normal.Interpolate(weight1, weight2).Normalized();
+			pixelToShade.tangent = triangle.tangent.Interpolate(weight1, weight2).Normalized();
+
+			// A coarse pixel covers more of the texture, so it samples a smaller mip level
+			TexcoordDerivatives texcoordDerivatives{ GetTexcoordDerivatives(triangle, pixelToShade.texcoord, w) };
+			texcoordDerivatives.dx *= static_cast<float>(GetShadingRateWidth(rate));
+			texcoordDerivatives.dy *= static_cast<float>(GetShadingRateHeight(rate));
+
+			finalColor = PixelShading(m, pixelToShade, texcoordDerivatives, viewDir);
+		}
+
+		finalColor.MaxToOne();
+		uint32_t const color{ SDL_MapRGB(m_pBackBuffer->format,
+			static_cast<uint8_t>(finalColor.r * 255),
+			static_cast<uint8_t>(finalColor.g * 255),
+			static_cast<uint8_t>(finalColor.b * 255)) };
+		if (pCoarseShade)
+		{
+			pCoarseShade->color = color;
+		}
+		return color;
+	}
+
+	void Renderer::BlendPixel(TriangleSetup const& triangle, int px, int py, float weight1, float weight2) const
+	{
+		uint32_t alpha{};
+		uint32_t const color{ ShadeTransparentFragment(triangle, px, py, weight1, weight2, alpha) };
+		uint32_t& pixel{ m_pBackBufferPixels[px + py * m_Width] };
+		pixel = LerpPackedColor(pixel, color, alpha);
+	}
+
+	uint32_t Renderer::ShadeTransparentFragment(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, uint32_t& alpha) const
+	{
+		// Same as PartialCoverage3D.fx: just the diffuse texture, blended src alpha / inverse src alpha
+		++m_Frames[m_RasterFrameIdx].tiles[px / TILE_SIZE + (py / TILE_SIZE) * m_NumTilesX].shadedFragments;
+
+		float const w{ 1.f / triangle.invW.Interpolate(weight1, weight2) };
+		Vector2 const texcoord{ triangle.texcoord.Interpolate(weight1, weight2) * w };
+		TexcoordDerivatives const texcoordDerivatives{ GetTexcoordDerivatives(triangle, texcoord, w) };
+		Sampler const sampler{ GetSampler(FIRE_ADDRESS_MODE) };
+
+		ColorRGB color{ m_pFireDiffuseTexture->Sample(texcoord, texcoordDerivatives, sampler) };
+		color.MaxToOne();
+		uint32_t const alpha8{ static_cast<uint32_t>(m_pFireDiffuseTexture->SampleAlpha(texcoord, texcoordDerivatives, sampler) * 255) };
+		alpha = alpha8 + (alpha8 >> 7); // Out of 256, so fully opaque really replaces the destination
+
+		return SDL_MapRGB(m_pBackBuffer->format,
+			static_cast<uint8_t>(color.r * 255),
+			static_cast<uint8_t>(color.g * 255),
+			static_cast<uint8_t>(color.b * 255));
+	}
+
+	TexcoordDerivatives Renderer::GetTexcoordDerivatives(TriangleSetup const& triangle, Vector2 const& texcoord, float w) const
+	{
+		// Exact derivatives of the perspective-correct texture coordinates (texcoord/w divided by 1/w) along one pixel in x and in y.
+		// Same thing a 2x2 quad gets from the difference with its neighbours, without shading those neighbours.
+		float const weight1DX{ static_cast<float>(triangle.edges[1].stepX) * triangle.invArea };
+		float const weight2DX{ static_cast<float>(triangle.edges[2].stepX) * triangle.invArea };
+		float const weight1DY{ static_cast<float>(triangle.edges[1].stepY) * triangle.invArea };
+		float const weight2DY{ static_cast<float>(triangle.edges[2].stepY) * triangle.invArea };
+
+		Vector2 const texcoordOverWDX{ triangle.texcoord.d1 * weight1DX + triangle.texcoord.d2 * weight2DX };
+		Vector2 const texcoordOverWDY{ triangle.texcoord.d1 * weight1DY + triangle.texcoord.d2 * weight2DY };
+		float const invWDX{ triangle.invW.d1 * weight1DX + triangle.invW.d2 * weight2DX };
+		float const invWDY{ triangle.invW.d1 * weight1DY + triangle.invW.d2 * weight2DY };
+
+		return { (texcoordOverWDX - texcoord * invWDX) * w, (texcoordOverWDY - texcoord * invWDY) * w };
+	}
+
+	ColorRGB Renderer::PixelShading(Mesh const* m, Vertex_Out const& v, TexcoordDerivatives const& texcoordDerivatives, Vector3 const& viewDir) const
 	{
 		//Global light & other defines
 		Vector3 static constexpr LIGHT_DIRECTION{ Vector3{.577f, -.577f, .577f} };
@@ -439,12 +2120,13 @@ namespace dae {
 		float static constexpr KD{ 7.f };
 
 		ColorRGB result{ };
+		Sampler const sampler{ GetSampler(VEHICLE_ADDRESS_MODE) };
 
 		// Normal mapping
 		Vector3 const biNormal = Vector3::Cross(v.normal, v.tangent);
 		Matrix const tangentSpaceAxis = { v.tangent, biNormal, v.normal, Vector3::Zero };
 
-		ColorRGB const normalColor = m_pVehicleNormalTexture->Sample(v.texcoord);
+		ColorRGB const normalColor = m_pVehicleNormalTexture->Sample(v.texcoord, texcoordDerivatives, sampler);
 		Vector3 sampledNormal = { normalColor.r, normalColor.g, normalColor.b }; //range [0, 1]
 		sampledNormal = 2.f * sampledNormal - Vector3{ 1, 1, 1 }; //[0, 1] to [-1, 1]
 		sampledNormal = tangentSpaceAxis.TransformVector(sampledNormal).Normalized();
@@ -466,7 +2148,7 @@ namespace dae {
 			{
 				return{ colors::Black };
 			}
-			result = BRDF::Lambert(KD, m_pVehicleDiffuseTexture->Sample(v.texcoord)) * observedArea;
+			result = BRDF::Lambert(KD, m_pVehicleDiffuseTexture->Sample(v.texcoord, texcoordDerivatives, sampler)) * observedArea;
 			break;
 		}
 		case ShadingMode::Specular:
@@ -475,7 +2157,7 @@ namespace dae {
 			{
 				return{ colors::Black };
 			}
-			result = observedArea * m_pVehicleSpecularTexture->Sample(v.texcoord).r * BRDF::Phong(1.f, SHININESS * m_pVehicleGlossinessTexture->Sample(v.texcoord).r, LIGHT_DIRECTION, viewDir, m_UseNormalMapping ? sampledNormal : v.normal);
+			result = observedArea * m_pVehicleSpecularTexture->SampleRed(v.texcoord, texcoordDerivatives, sampler) * BRDF::Phong(1.f, SHININESS * m_pVehicleGlossinessTexture->SampleRed(v.texcoord, texcoordDerivatives, sampler), LIGHT_DIRECTION, viewDir, m_UseNormalMapping ? sampledNormal : v.normal);
 			break;
 		}
 		case ShadingMode::Combined:
@@ -484,8 +2166,8 @@ namespace dae {
 			{
 				return{ colors::Black };
 			}
-			auto const lambert{ BRDF::Lambert(KD, m_pVehicleDiffuseTexture->Sample(v.texcoord)) };
-			ColorRGB const phong = m_pVehicleSpecularTexture->Sample(v.texcoord).r * BRDF::Phong(1.f, SHININESS * m_pVehicleGlossinessTexture->Sample(v.texcoord).r,LIGHT_DIRECTION, viewDir, m_UseNormalMapping ? sampledNormal : v.normal);
+			auto const lambert{ BRDF::Lambert(KD, m_pVehicleDiffuseTexture->Sample(v.texcoord, texcoordDerivatives, sampler)) };
+			ColorRGB const phong = m_pVehicleSpecularTexture->SampleRed(v.texcoord, texcoordDerivatives, sampler) * BRDF::Phong(1.f, SHININESS * m_pVehicleGlossinessTexture->SampleRed(v.texcoord, texcoordDerivatives, sampler),LIGHT_DIRECTION, viewDir, m_UseNormalMapping ? sampledNormal : v.normal);
 
 
 			result = observedArea * lambert + phong;
@@ -7,6 +7,9 @@
 #include <memory>
 
 #include "Mesh.h"
+#include "TriangleSetup.h"
+#include "SIMD.h"
+#include "JobSystem.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -14,6 +17,7 @@ struct SDL_Surface;
 namespace dae
 {
 	class Texture;
+	struct TexcoordDerivatives;
 	class Mesh;
 
 	class Renderer final
@@ -64,14 +68,9 @@ namespace dae
 			std::cout << "Rotation -> " << RED << "Disabled\n";
 			std::cout << RESET;
 		}
-		// When F3 is pressed, switch beteen displaying or not displaying the fire mesh (only for the hardware rasterizer currently)
+		// When F3 is pressed, switch beteen displaying or not displaying the fire mesh
 		void ToggleFireMesh() noexcept
 		{
-			if (m_IsSofwareRasterizerMode)
-			{
-				std::cout << RED << "Not in software rasterizer, can not toggle fire mesh setting\n" << RESET;
-				return;
-			}
 			m_DisplayFireMesh = !m_DisplayFireMesh;
 			if (m_DisplayFireMesh)
 			{
@@ -82,7 +81,7 @@ namespace dae
 			std::cout << "FireMesh -> " << RED << "Disabled\n";
 			std::cout << RESET;
 		}
-		// When F4 is pressed, change to next sampler state (only for the hardware rasterizer currently)
+		// When F4 is pressed, change to next sampler state
 		void ChangeSamplerState() noexcept;
 		// When F5 is pressed change to the next shading mode (only for the software rasterizer currently)
 		void ChangeShadingMode() noexcept
@@ -228,6 +227,153 @@ namespace dae
 			std::cout << "Use uniform clear color ->" << RED << " Disabled\n";
 			std::cout << RESET;
 		}
+		// When F12 is pressed, switch to the next render path (only for the software rasterizer currently)
+		void ChangeRenderPath() noexcept
+		{
+			if (!m_IsSofwareRasterizerMode)
+			{
+				std::cout << RED << "Not in software rasterizer, can not cycle render path setting\n" << RESET;
+				return;
+			}
+			auto curr{ static_cast<uint8_t>(m_CurrRenderPath) };
+			++curr %= static_cast<uint8_t>(RenderPath::COUNT);
+
+			m_CurrRenderPath = static_cast<RenderPath>(curr);
+
+			switch (m_CurrRenderPath)
+			{
+			case RenderPath::Forward:
+				std::cout << "Render path -> " << GREEN << "Forward\n";
+				std::cout << RESET;
+				break;
+			case RenderPath::VisibilityBuffer:
+				std::cout << "Render path -> " << GREEN << "VisibilityBuffer\n";
+				std::cout << RESET;
+				break;
+			case RenderPath::ZPrepass:
+				std::cout << "Render path -> " << GREEN << "ZPrepass\n";
+				std::cout << RESET;
+				break;
+			default: break;
+			}
+		}
+		// When P is pressed, toggle frame pipelining (only for the software rasterizer).
+		// The geometry of the next frame is processed while the current one is rasterized, so what is shown lags one frame behind.
+		void ToggleFramePipelining() noexcept
+		{
+			if (!m_IsSofwareRasterizerMode)
+			{
+				std::cout << RED << "Not in software rasterizer, can not toggle frame pipelining\n" << RESET;
+				return;
+			}
+
+			m_IsFramePipelined = !m_IsFramePipelined;
+			if (m_IsFramePipelined)
+			{
+				std::cout << "Frame pipelining ->" << GREEN << " Enabled" << YELLOW << " (+1 frame of latency)\n";
+				std::cout << RESET;
+				return;
+			}
+			std::cout << "Frame pipelining ->" << RED << " Disabled\n";
+			std::cout << RESET;
+		}
+		// When M is pressed, toggle 4x MSAA (only for the software rasterizer)
+		void ToggleMSAA() noexcept
+		{
+			if (!m_IsSofwareRasterizerMode)
+			{
+				std::cout << RED << "Not in software rasterizer, can not toggle MSAA\n" << RESET;
+				return;
+			}
+
+			m_IsMSAAEnabled = !m_IsMSAAEnabled;
+			if (m_IsMSAAEnabled)
+			{
+				CreateMSAABuffers();
+				std::cout << "4x MSAA ->" << GREEN << " Enabled";
+				if (m_CurrRenderPath == RenderPath::VisibilityBuffer)
+				{
+					std::cout << YELLOW << " (the visibility buffer stores one triangle per pixel, renders as forward)";
+				}
+				std::cout << "\n" << RESET;
+				return;
+			}
+			std::cout << "4x MSAA ->" << RED << " Disabled\n";
+			std::cout << RESET;
+		}
+		// When V is pressed, toggle variable rate shading (only for the software rasterizer).
+		// Flat parts of the previous frame get shaded at a lower rate, depth and coverage stay per pixel.
+		void ToggleVariableRateShading() noexcept
+		{
+			if (!m_IsSofwareRasterizerMode)
+			{
+				std::cout << RED << "Not in software rasterizer, can not toggle variable rate shading\n" << RESET;
+				return;
+			}
+
+			m_IsVariableRateShading = !m_IsVariableRateShading;
+			if (m_IsVariableRateShading)
+			{
+				// Nothing is known about the content yet, the first frame is shaded at full rate
+				std::fill_n(m_pShadingRates, m_NumRateTilesX * m_NumRateTilesY, ShadingRate::Rate1x1);
+				std::cout << "Variable rate shading ->" << GREEN << " Enabled\n";
+				std::cout << RESET;
+				return;
+			}
+			std::cout << "Variable rate shading ->" << RED << " Disabled\n";
+			std::cout << RESET;
+		}
+		// When R is pressed, toggle dynamic resolution (only for the software rasterizer).
+		// The software rasterizer renders at a lower internal resolution when it misses the frame time target, and is upscaled to the window.
+		void ToggleDynamicResolution() noexcept
+		{
+			if (!m_IsSofwareRasterizerMode)
+			{
+				std::cout << RED << "Not in software rasterizer, can not toggle dynamic resolution\n" << RESET;
+				return;
+			}
+
+			m_IsDynamicResolution = !m_IsDynamicResolution;
+			m_AverageFrameTime = m_TargetFrameTime;
+			m_FramesSinceResize = 0;
+			if (m_IsDynamicResolution)
+			{
+				std::cout << "Dynamic resolution ->" << GREEN << " Enabled" << YELLOW << " (target " << m_TargetFrameTime * 1000.f << " ms)\n";
+				std::cout << RESET;
+				return;
+			}
+			SetRenderResolution(m_Width);
+			std::cout << "Dynamic resolution ->" << RED << " Disabled\n";
+			std::cout << RESET;
+		}
+		// When T is pressed, switch to the next frame time target of the dynamic resolution
+		void ChangeFrameTimeTarget() noexcept
+		{
+			if (!m_IsSofwareRasterizerMode)
+			{
+				std::cout << RED << "Not in software rasterizer, can not cycle frame time target setting\n" << RESET;
+				return;
+			}
+			m_CurrFrameTimeTarget = (m_CurrFrameTimeTarget + 1) % std::size(FRAME_TIME_TARGETS);
+			m_TargetFrameTime = FRAME_TIME_TARGETS[m_CurrFrameTimeTarget];
+			m_FramesSinceResize = 0;
+			std::cout << "Frame time target -> " << GREEN << m_TargetFrameTime * 1000.f << " ms (" << 1.f / m_TargetFrameTime << " FPS)\n";
+			std::cout << RESET;
+		}
+		// Fraction of the window width the software rasterizer renders at, 1 when dynamic resolution is off
+		[[nodiscard]] float GetRenderScale() const noexcept
+		{
+			return static_cast<float>(m_RenderWidth) / static_cast<float>(m_Width);
+		}
+		// Frames between an update and the frame that shows it on screen
+		[[nodiscard]] int GetFrameLatency() const noexcept
+		{
+			return m_IsSofwareRasterizerMode && m_IsFramePipelined ? 1 : 0;
+		}
+		// When L is pressed, switch the software textures between a row by row and a Morton (Z-order) texel layout
+		void ToggleTexelLayout();
+		// When B is pressed, render the same frame with every render path (with and without MSAA) and print the timings
+		void BenchmarkRenderPaths();
 	#pragma endregion
 
 	private:
@@ -236,6 +382,18 @@ namespace dae
 		int m_Width{};
 		int m_Height{};
 
+		// Internal resolution of the software rasterizer, it renders to the top left of every buffer (the row pitch stays m_Width).
+		// Picked every Update from the average frame time, the back buffer is upscaled to the window when it is smaller.
+		int m_RenderWidth{};
+		int m_RenderHeight{};
+		bool m_IsDynamicResolution{ false };
+		float static constexpr FRAME_TIME_TARGETS[]{ 1.f / 60.f, 1.f / 30.f, 1.f / 120.f };
+		size_t m_CurrFrameTimeTarget{ 0 };
+		float m_TargetFrameTime{ FRAME_TIME_TARGETS[0] };
+		float m_AverageFrameTime{ FRAME_TIME_TARGETS[0] };
+		int m_FramesSinceResize{ 0 };
+		SDL_Surface* m_pUpscaleBuffer{ nullptr }; // Window sized, same format as the back buffer
+
 		Camera m_Camera{};
 
 		//Software rasiterizer
@@ -245,6 +403,86 @@ namespace dae
 
 		float* m_pDepthBufferPixels{ nullptr };
 
+		// Hierarchical depth: the max depth of every 8x8 block of the depth buffer.
+		// Writes only mark a block dirty, its max gets recalculated the next time the block is tested.
+		int static constexpr HIZ_BLOCK_SIZE{ 8 };
+		static_assert(HIZ_BLOCK_SIZE % simd::WIDTH == 0, "A block row has to be a whole number of SIMD chunks");
+		int m_HiZWidth{};
+		int m_HiZHeight{};
+		float* m_pHiZBuffer{ nullptr };
+		bool* m_pHiZDirty{ nullptr };
+
+		// Visibility buffer: rasterization only stores which triangle covers a pixel, every pixel gets shaded exactly once afterwards
+		VisibilityTexel* m_pVisibilityBuffer{ nullptr };
+
+		// Z-prepass: the triangle that wrote the final depth of every pixel. Triangles at exactly the same depth all match it,
+		// the shading pass only shades the one the depth pass ended with (the same one forward keeps).
+		uint32_t* m_pDepthOwners{ nullptr };
+
+		// 4x MSAA: depth and color per sample, stored as MSAA_SAMPLES planes of m_Width * m_Height.
+		// Shading runs once per pixel per triangle, its color goes to every sample the triangle covers. Resolved per tile.
+		// m_pDepthBufferPixels then holds the furthest sample of every pixel, which is all the hierarchical depth needs.
+		// The buffers are only created once MSAA gets enabled.
+		bool m_IsMSAAEnabled{ false };
+		float* m_pSampleDepths{ nullptr };
+		uint32_t* m_pSampleColors{ nullptr };
+		uint32_t* m_pSampleOwners{ nullptr }; // m_pDepthOwners per sample
+
+		// Variable rate shading: a shading rate per rate tile, picked from the luminance gradients of the previous frame.
+		// Every tile updates the rates of its own rate tiles once it is done, the next frame reads them.
+		bool m_IsVariableRateShading{ false };
+		int m_NumRateTilesX{};
+		int m_NumRateTilesY{};
+		ShadingRate* m_pShadingRates{ nullptr };
+		CoarseShade* m_pCoarseShades{ nullptr }; // MAX_COARSE_PIXELS_PER_RATE_TILE per rate tile
+		// A coarse pixel may be off from its neighbours by this fraction of the luminance around it (out of 255)
+		float static constexpr VRS_SENSITIVITY{ 0.15f };
+		float static constexpr VRS_MIN_LUMINANCE{ 16.f }; // Added to the luminance, so the darkest parts don't get any error they want
+
+		// Sort-middle binning: triangles are set up once per frame, then every tile rasterizes the ones overlapping it
+		int static constexpr TILE_SIZE{ 64 };
+		static_assert(TILE_SIZE % RATE_TILE_SIZE == 0, "Every rate tile has to be inside a single tile");
+		int m_NumTilesX{};
+		int m_NumTilesY{};
+		mutable uint32_t m_ShadedFragments{}; // PixelShading calls during the last frame, over all tiles
+
+		// Bounding box sizes (in pixels) that pick the rasterization loop of a triangle
+		int static constexpr TINY_TRIANGLE_SIZE{ 4 }; // Width and height at most this: Tiny
+		int static constexpr SPAN_TRIANGLE_SIZE{ 32 }; // Width and height at least this: Span
+
+		// Everything the rasterization stage reads from the geometry stage, the vertex streams are not needed anymore after setup.
+		// With frame pipelining the geometry stage fills one while the other one is rasterized, otherwise only the raster frame is used.
+		struct SoftwareFrame
+		{
+			std::vector<TriangleSetup> triangles{};
+			std::vector<Tile> tiles{};
+			Vector3 cameraOrigin{};
+			// Transparent triangles sorted back to front, and the buffers the sort works in
+			std::vector<uint32_t> transparentTriangles{};
+			std::vector<uint32_t> sortKeys{};
+			std::vector<uint32_t> sortScratch[2]{};
+			int renderWidth{};
+			int renderHeight{};
+			bool isMSAAEnabled{}; // M can be pressed while the frame is in flight, setup and rasterization have to agree
+			uint32_t rasterMethodCounts[static_cast<size_t>(RasterMethod::COUNT)]{}; // Binned triangles per rasterization loop
+		};
+		mutable SoftwareFrame m_Frames[2]{};
+		mutable uint32_t m_RasterFrameIdx{ 0 };
+		mutable bool m_IsFrameInFlight{ false }; // The raster frame is set up but not rasterized yet
+		bool m_IsFramePipelined{ false };
+
+		// Geometry work of one mesh for the current frame, filled in before any job starts so the jobs only read it
+		struct MeshGeometry
+		{
+			std::vector<uint32_t> vertexBlocks{}; // Blocks of simd::WIDTH vertices the vertex stage has to transform
+			std::vector<uint32_t> meshletTriangleOffsets{}; // First triangle slot of every visible meshlet
+			size_t firstTriangle{};
+			size_t numTriangles{};
+		};
+		mutable std::vector<MeshGeometry> m_MeshGeometry{}; // Indexed like m_Meshes
+
+		// Every software stage runs on this, the worker threads live as long as the renderer
+		std::unique_ptr<JobSystem> m_pJobSystem{ nullptr };
 
 		//DirectX
 		bool m_IsDirectXInitialized{ false }; // Only want to render when DirectX is properly initialized
@@ -263,6 +501,8 @@ namespace dae
 
 		//Models
 		std::vector<std::unique_ptr<Mesh>> m_Meshes;
+		BoundsStream m_MeshBounds{}; // World space bounds of every mesh, updated every frame
+		std::vector<bool> m_IsMeshVisible{}; // Result of the frustum culling, per mesh
 
 		//Textures
 		// would be in resource manager
@@ -271,6 +511,9 @@ namespace dae
 		std::unique_ptr<Texture> m_pVehicleGlossinessTexture{ nullptr };
 		std::unique_ptr<Texture> m_pVehicleSpecularTexture{ nullptr };
 		std::unique_ptr<Texture> m_pFireDiffuseTexture{ nullptr };
+		// The vehicle textures tile, the fire texture does not and should not bleed over its edges (same addressing as the effects)
+		AddressMode static constexpr VEHICLE_ADDRESS_MODE{ AddressMode::Wrap };
+		AddressMode static constexpr FIRE_ADDRESS_MODE{ AddressMode::Clamp };
 
 		//Settings
 		bool m_IsSofwareRasterizerMode{ false };
@@ -286,6 +529,22 @@ namespace dae
 			COUNT
 		};
 		ShadingMode m_CurrShadingMode{ ShadingMode::Combined };
+		enum class RenderPath : uint8_t
+		{
+			Forward = 0, // Shade every fragment that passes the depth test
+			VisibilityBuffer = 1, // Rasterize triangle ids first, shade visible pixels afterwards
+			ZPrepass = 2, // Rasterize depth only first, then shade the fragments that match the final depth
+			COUNT
+		};
+		// What rasterizing a triangle does with the fragments that pass the depth test
+		enum class RasterPass : uint8_t
+		{
+			DepthAndShade, // Single pass: write the depth and shade (or fill the visibility buffer)
+			DepthOnly, // Z-prepass: only write the depth, no attributes and no shading
+			ShadeEqualDepth, // After the Z-prepass: shade the fragment that wrote the stored depth, one per pixel (see m_pDepthOwners)
+			Blend // Transparent, after all opaque triangles: depth test without writing, blended over what is already there
+		};
+		RenderPath m_CurrRenderPath{ RenderPath::Forward };
 		bool m_UseNormalMapping{ true };
 		bool m_ShowDepthBuffer{ false };
 		bool m_ShowBoundingBoxes{ false };
@@ -304,9 +563,52 @@ namespace dae
 
 		//Software
 		void RenderSoftware() const;
-		void VertexTransformationFunction(std::vector<Vector2>& screenSpace, Mesh* mesh) const;
-		void RenderTriangle(Mesh* m, std::vector<Vector2> const& vertices, uint32_t startVertex, bool swapVertex) const;
+		[[nodiscard]] Job* RunGeometryStage(SoftwareFrame& frame) const;
+		void RasterizeFrame() const;
+		void PresentUpscaled(int renderWidth, int renderHeight) const;
+		void BenchmarkTexelLayouts();
+		void UpdateRenderResolution(float elapsedSec) noexcept;
+		void SetRenderResolution(int renderWidth) noexcept;
+		void PrepareVertexTransformation(Mesh* mesh, std::vector<uint32_t>& vertexBlocks) const;
+		void VertexTransformationFunction(Mesh* mesh, uint32_t const* pBlocks, size_t numBlocks) const;
+		void SetupMeshTriangle(Mesh* mesh, uint32_t t, TriangleSetup& triangle, SoftwareFrame const& frame) const;
+		[[nodiscard]] ProjectedVertex ProjectVertex(Vertex_Out const& v) const;
+		[[nodiscard]] bool SetupTriangle(Mesh const* m, ProjectedVertex v0, ProjectedVertex v1, ProjectedVertex v2, TriangleSetup& triangle, SoftwareFrame const& frame) const;
+		void ClipTriangle(Mesh const* m, TriangleSetup const& triangle, SoftwareFrame& frame) const;
+		void BinTriangles(SoftwareFrame& frame) const;
+		void RenderTile(Tile const& tile) const;
+		void RenderTriangle(TriangleSetup const& triangle, Tile const& tile, RasterPass pass) const;
+		void RenderPixelMSAA(TriangleSetup const& triangle, SampleDeltas const& deltas, int px, int py, int64_t const (&edges)[3], RasterPass pass) const;
+		void CreateMSAABuffers();
+		void ResolveTile(Tile const& tile) const;
+		void ResetCoarseShades(Tile const& tile) const;
+		void UpdateShadingRates(Tile const& tile) const;
+		void RenderTriangleTiny(TriangleSetup const& triangle, int minX, int minY, int maxX, int maxY, RasterPass pass) const;
+		void RenderTriangleScalar(TriangleSetup const& triangle, int minX, int minY, int maxX, int maxY, RasterPass pass) const;
+		[[nodiscard]] float GetBlockMaxDepth(int blockIdx) const;
+		void WriteFragment(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, float interpolatedDepth) const;
+		void ShadeVisibilityBuffer(Tile const& tile) const;
+		void ShadePixel(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, float interpolatedDepth) const;
+		[[nodiscard]] uint32_t ShadeFragment(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, float interpolatedDepth) const;
+		void BlendPixel(TriangleSetup const& triangle, int px, int py, float weight1, float weight2) const;
+		[[nodiscard]] uint32_t ShadeTransparentFragment(TriangleSetup const& triangle, int px, int py, float weight1, float weight2, uint32_t& alpha) const;
+		[[nodiscard]] bool IsTransparent(Mesh const* m) const noexcept
+		{
+			// Hard coded like everywhere else, the fire mesh is the only transparent one
+			return m == m_Meshes[1].get();
+		}
+
+		[[nodiscard]] uint32_t GetTriangleIdx(TriangleSetup const& triangle) const noexcept
+		{
+			return static_cast<uint32_t>(&triangle - m_Frames[m_RasterFrameIdx].triangles.data());
+		}
 
-		[[nodiscard]] ColorRGB PixelShading(Mesh const* m, Vertex_Out const& v, Vector3 const& viewDir) const;
+		[[nodiscard]] TexcoordDerivatives GetTexcoordDerivatives(TriangleSetup const& triangle, Vector2 const& texcoord, float w) const;
+		// Filter of the current technique and the 16x anisotropy of the effect samplers, addressing picked per texture
+		[[nodiscard]] Sampler GetSampler(AddressMode address) const noexcept
+		{
+			return Sampler{ m_SamplerState, address };
+		}
+		[[nodiscard]] ColorRGB PixelShading(Mesh const* m, Vertex_Out const& v, TexcoordDerivatives const& texcoordDerivatives, Vector3 const& viewDir) const;
 	};
 }
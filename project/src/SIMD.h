@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+
+// Small wrapper around the intrinsics the software rasterizer uses.
+// Builds with AVX2 enabled process 8 pixels at once, everything else falls back to 4 wide SSE2 (always available on x64).
+// Masks are stored as integer lanes with all bits set (true) or cleared (false).
+#if defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+namespace dae::simd
+{
+#if defined(__AVX2__)
+	int constexpr WIDTH{ 8 };
+	using Float = __m256;
+	using Int = __m256i;
+
+	[[nodiscard]] inline Float SetFloat(float f) noexcept { return _mm256_set1_ps(f); }
+	[[nodiscard]] inline Int SetInt(int i) noexcept { return _mm256_set1_epi32(i); }
+	// { start, start + step, start + 2 * step, ... }
+	[[nodiscard]] inline Int Ramp(int start, int step) noexcept
+	{
+		return _mm256_add_epi32(_mm256_set1_epi32(start), _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+	}
+
+	[[nodiscard]] inline Int Add(Int a, Int b) noexcept { return _mm256_add_epi32(a, b); }
+	[[nodiscard]] inline Int Or(Int a, Int b) noexcept { return _mm256_or_si256(a, b); }
+	[[nodiscard]] inline Int And(Int a, Int b) noexcept { return _mm256_and_si256(a, b); }
+	[[nodiscard]] inline Int Greater(Int a, Int b) noexcept { return _mm256_cmpgt_epi32(a, b); }
+
+	[[nodiscard]] inline Float ToFloat(Int a) noexcept { return _mm256_cvtepi32_ps(a); }
+	[[nodiscard]] inline Float Add(Float a, Float b) noexcept { return _mm256_add_ps(a, b); }
+	[[nodiscard]] inline Float Sub(Float a, Float b) noexcept { return _mm256_sub_ps(a, b); }
+	[[nodiscard]] inline Float Mul(Float a, Float b) noexcept { return _mm256_mul_ps(a, b); }
+	[[nodiscard]] inline Float Div(Float a, Float b) noexcept { return _mm256_div_ps(a, b); }
+	[[nodiscard]] inline Float Max(Float a, Float b) noexcept { return _mm256_max_ps(a, b); }
+	[[nodiscard]] inline Int LessEqual(Float a, Float b) noexcept { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+	[[nodiscard]] inline Int Less(Float a, Float b) noexcept { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+	[[nodiscard]] inline Int Equal(Float a, Float b) noexcept { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+
+	// One bit per lane, lane 0 is the lowest bit
+	[[nodiscard]] inline uint32_t MoveMask(Int mask) noexcept { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(mask))); }
+
+	// Lanes that are not in the mask are never touched in memory, so these are safe at the edges of the buffers
+	[[nodiscard]] inline Float LoadMasked(float const* p, Int mask) noexcept { return _mm256_maskload_ps(p, mask); }
+	inline void StoreMasked(float* p, Int mask, Float v) noexcept { _mm256_maskstore_ps(p, mask, v); }
+	inline void StoreMasked(uint32_t* p, Int mask, Int v) noexcept { _mm256_maskstore_epi32(reinterpret_cast<int*>(p), mask, v); }
+	[[nodiscard]] inline Float Load(float const* p) noexcept { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, Float v) noexcept { _mm256_storeu_ps(p, v); }
+	[[nodiscard]] inline Int Load(uint32_t const* p) noexcept { return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)); }
+	inline void Store(uint32_t* p, Int v) noexcept { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+	// Logical shifts of every lane
+	template<int BITS>
+	[[nodiscard]] inline Int ShiftLeft(Int a) noexcept { return _mm256_slli_epi32(a, BITS); }
+	template<int BITS>
+	[[nodiscard]] inline Int ShiftRight(Int a) noexcept { return _mm256_srli_epi32(a, BITS); }
+#else
+	int constexpr WIDTH{ 4 };
+	using Float = __m128;
+	using Int = __m128i;
+
+	[[nodiscard]] inline Float SetFloat(float f) noexcept { return _mm_set1_ps(f); }
+	[[nodiscard]] inline Int SetInt(int i) noexcept { return _mm_set1_epi32(i); }
+	// { start, start + step, start + 2 * step, ... }
+	[[nodiscard]] inline Int Ramp(int start, int step) noexcept { return _mm_setr_epi32(start, start + step, start + 2 * step, start + 3 * step); }
+
+	[[nodiscard]] inline Int Add(Int a, Int b) noexcept { return _mm_add_epi32(a, b); }
+	[[nodiscard]] inline Int Or(Int a, Int b) noexcept { return _mm_or_si128(a, b); }
+	[[nodiscard]] inline Int And(Int a, Int b) noexcept { return _mm_and_si128(a, b); }
+	[[nodiscard]] inline Int Greater(Int a, Int b) noexcept { return _mm_cmpgt_epi32(a, b); }
+
+	[[nodiscard]] inline Float ToFloat(Int a) noexcept { return _mm_cvtepi32_ps(a); }
+	[[nodiscard]] inline Float Add(Float a, Float b) noexcept { return _mm_add_ps(a, b); }
+	[[nodiscard]] inline Float Sub(Float a, Float b) noexcept { return _mm_sub_ps(a, b); }
+	[[nodiscard]] inline Float Mul(Float a, Float b) noexcept { return _mm_mul_ps(a, b); }
+	[[nodiscard]] inline Float Div(Float a, Float b) noexcept { return _mm_div_ps(a, b); }
+	[[nodiscard]] inline Float Max(Float a, Float b) noexcept { return _mm_max_ps(a, b); }
+	[[nodiscard]] inline Int LessEqual(Float a, Float b) noexcept { return _mm_castps_si128(_mm_cmple_ps(a, b)); }
+	[[nodiscard]] inline Int Less(Float a, Float b) noexcept { return _mm_castps_si128(_mm_cmplt_ps(a, b)); }
+	[[nodiscard]] inline Int Equal(Float a, Float b) noexcept { return _mm_castps_si128(_mm_cmpeq_ps(a, b)); }
+
+	// One bit per lane, lane 0 is the lowest bit
+	[[nodiscard]] inline uint32_t MoveMask(Int mask) noexcept { return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(mask))); }
+
+	// SSE2 has no masked float load/store, go through the lanes one by one instead
+	[[nodiscard]] inline Float LoadMasked(float const* p, Int mask) noexcept
+	{
+		uint32_t const bits{ MoveMask(mask) };
+		return _mm_setr_ps(bits & 1 ? p[0] : 0.f, bits & 2 ? p[1] : 0.f, bits & 4 ? p[2] : 0.f, bits & 8 ? p[3] : 0.f);
+	}
+	inline void StoreMasked(float* p, Int mask, Float v) noexcept
+	{
+		alignas(16) float values[WIDTH];
+		_mm_store_ps(values, v);
+		uint32_t const bits{ MoveMask(mask) };
+		for (int i{ 0 }; i < WIDTH; ++i)
+		{
+			if (bits & (1u << i))
+			{
+				p[i] = values[i];
+			}
+		}
+	}
+	inline void StoreMasked(uint32_t* p, Int mask, Int v) noexcept
+	{
+		alignas(16) uint32_t values[WIDTH];
+		_mm_store_si128(reinterpret_cast<__m128i*>(values), v);
+		uint32_t const bits{ MoveMask(mask) };
+		for (int i{ 0 }; i < WIDTH; ++i)
+		{
+			if (bits & (1u << i))
+			{
+				p[i] = values[i];
+			}
+		}
+	}
+	[[nodiscard]] inline Float Load(float const* p) noexcept { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Float v) noexcept { _mm_storeu_ps(p, v); }
+	[[nodiscard]] inline Int Load(uint32_t const* p) noexcept { return _mm_loadu_si128(reinterpret_cast<__m128i const*>(p)); }
+	inline void Store(uint32_t* p, Int v) noexcept { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+
+	// Logical shifts of every lane
+	template<int BITS>
+	[[nodiscard]] inline Int ShiftLeft(Int a) noexcept { return _mm_slli_epi32(a, BITS); }
+	template<int BITS>
+	[[nodiscard]] inline Int ShiftRight(Int a) noexcept { return _mm_srli_epi32(a, BITS); }
+#endif
+
+	// Bilinear filter of four packed 8 bit per channel texels (t10 is right of t00, t01 below it), weights are out of 256.
+	// All four channels of two texels at once in 16 bit lanes, SSE2 on every path since it is one pixel at a time.
+	[[nodiscard]] inline uint32_t BilinearPacked(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, uint32_t weightX, uint32_t weightY) noexcept
+	{
+		// The four weights add up to exactly 256, so 255 * 256 is the largest sum and a 16 bit lane never overflows
+		uint32_t const w11{ (weightX * weightY) >> 8 };
+		uint32_t const w10{ weightX - w11 };
+		uint32_t const w01{ weightY - w11 };
+		uint32_t const w00{ 256 - weightX - weightY + w11 };
+
+		__m128i const zero{ _mm_setzero_si128() };
+		__m128i const top{ _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(t00)), _mm_cvtsi32_si128(static_cast<int>(t10))), zero) };
+		__m128i const bottom{ _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(t01)), _mm_cvtsi32_si128(static_cast<int>(t11))), zero) };
+		__m128i const topWeights{ _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<short>(w00)), _mm_set1_epi16(static_cast<short>(w10))) };
+		__m128i const bottomWeights{ _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<short>(w01)), _mm_set1_epi16(static_cast<short>(w11))) };
+
+		__m128i sum{ _mm_add_epi16(_mm_mullo_epi16(top, topWeights), _mm_mullo_epi16(bottom, bottomWeights)) };
+		sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8)); // Left texels + right texels
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+	}
+}
@@ -3,33 +3,96 @@
 #include "pch.h"
 #include "ColorRGB.h"
 #include "Vector2.h"
+#include "JobSystem.h"
+#include "SIMD.h"
+#include <bit>
+#include <cstring>
 #include <filesystem>
+#include <new>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 namespace dae
 {
+	// How the texels are stored for the software rasterizer, picked per texture by what it's used for
+	enum class TexelFormat : uint8_t
+	{
+		RGBA8, // Colour textures, 4 bytes per texel
+		R8 // Textures of which only the red channel is read (glossiness, specular), 1 byte per texel
+	};
+
+	// Order of the texels in memory
+	enum class TexelLayout : uint8_t
+	{
+		Linear, // Row after row
+		Morton // Z-order: texels that are close in 2D are close in memory, whatever direction a triangle walks the texture in
+	};
+
+	// Filter of the samplers, for both rasterizers (the effects have a technique per state)
+	enum class SamplerState : uint8_t
+	{
+		Point = 0,
+		Linear = 1,
+		Anisotropic = 2,
+		COUNT
+	};
+
+	// What happens to texture coordinates outside of [0, 1]
+	enum class AddressMode : uint8_t
+	{
+		Wrap, // Repeats the texture
+		Clamp // Repeats the edge texels, for textures that do not tile
+	};
+
+	// Software counterpart of a D3D11 sampler state
+	struct Sampler
+	{
+		SamplerState filter{ SamplerState::Point };
+		AddressMode address{ AddressMode::Wrap };
+		uint32_t maxAnisotropy{ 16 };
+	};
+
+	// How far the texture coordinates move per pixel on screen, along x and along y. Picks the mip level.
+	struct TexcoordDerivatives
+	{
+		Vector2 dx{};
+		Vector2 dy{};
+	};
+
 	class Texture final
 	{
 	public:
-		Texture(std::filesystem::path const& path, ID3D11Device* pDevice)
+		Texture(std::filesystem::path const& path, ID3D11Device* pDevice, JobSystem& jobSystem, TexelFormat texelFormat = TexelFormat::RGBA8) :
+			m_TexelFormat{ texelFormat }
 		{
 			assert(std::filesystem::exists(path));
 
-			assert(std::filesystem::exists(path));
-
-			m_pSurface = IMG_Load(path.string().c_str());
-			if (!m_pSurface)
+			SDL_Surface* const pLoadedSurface{ IMG_Load(path.string().c_str()) };
+			if (!pLoadedSurface)
 				throw std::runtime_error("Failed to load texture from path: " + path.string());
 
-			m_pSurfacePixels = reinterpret_cast<uint32_t*>(m_pSurface->pixels);
+			// Decode once to a fixed byte order, so sampling is a plain load instead of an SDL_GetRGB per sample
+			SDL_Surface* const pSurface{ SDL_ConvertSurfaceFormat(pLoadedSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+			SDL_FreeSurface(pLoadedSurface);
+			if (!pSurface)
+				throw std::runtime_error("Failed to convert texture from path: " + path.string());
+
+			// The same mip chain is used by both rasterizers
+			std::vector<std::vector<uint32_t>> const mips{ GenerateMips(pSurface, jobSystem) };
+			CreateTexels(mips, pSurface->w, pSurface->h);
+			m_IsPowerOfTwo = std::has_single_bit(GetWidth()) && std::has_single_bit(GetHeight());
+			SDL_FreeSurface(pSurface);
 
 			assert(pDevice);
 
 
 			DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
 			D3D11_TEXTURE2D_DESC desc{};
-			desc.Width = m_pSurface->w;
-			desc.Height = m_pSurface->h;
-			desc.MipLevels = 1;
+			desc.Width = m_Levels[0].width;
+			desc.Height = m_Levels[0].height;
+			desc.MipLevels = static_cast<UINT>(mips.size());
 			desc.ArraySize = 1;
 			desc.Format = format;
 			desc.SampleDesc.Count = 1;
@@ -39,12 +102,15 @@ namespace dae
 			desc.CPUAccessFlags = 0;
 			desc.MiscFlags = 0;
 
-			D3D11_SUBRESOURCE_DATA initData{};
-			initData.pSysMem = m_pSurface->pixels;
-			initData.SysMemPitch = static_cast<UINT>(m_pSurface->pitch);
-			initData.SysMemSlicePitch = static_cast<UINT>(m_pSurface->h * m_pSurface->pitch);
+			std::vector<D3D11_SUBRESOURCE_DATA> initData(mips.size());
+			for (size_t i{ 0 }; i < mips.size(); ++i)
+			{
+				initData[i].pSysMem = mips[i].data();
+				initData[i].SysMemPitch = static_cast<UINT>(m_Levels[i].width * sizeof(uint32_t));
+				initData[i].SysMemSlicePitch = static_cast<UINT>(mips[i].size() * sizeof(uint32_t));
+			}
 			
-			HRESULT hr = pDevice->CreateTexture2D(&desc, &initData, &m_pResource);
+			HRESULT hr = pDevice->CreateTexture2D(&desc, initData.data(), &m_pResource);
 			
 			if (FAILED(hr))
 				throw std::runtime_error("Failed to create texture from path: " + path.string());
@@ -52,18 +118,18 @@ namespace dae
 			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
 			srvDesc.Format = format;
 			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-			srvDesc.Texture2D.MipLevels = 1;
+			srvDesc.Texture2D.MipLevels = desc.MipLevels;
 
 			hr = pDevice->CreateShaderResourceView(m_pResource, &srvDesc, &m_pShaderResourceView);
 			if (FAILED(hr))
+			{
+				// The destructor doesn't run when the constructor throws
+				SAFE_RELEASE(m_pResource)
 				throw std::runtime_error("Failed to create shader resource view from path: " + path.string());
+			}
 		}
 		~Texture()
 		{
-			if (m_pSurface)
-			{
-				SDL_FreeSurface(m_pSurface);
-			}
 			SAFE_RELEASE(m_pShaderResourceView)
 			SAFE_RELEASE(m_pResource)
 		}
@@ -82,26 +148,424 @@ namespace dae
 		Texture& operator=(const Texture&) = delete;
 		Texture& operator=(Texture&&) noexcept = delete;
 
-		ColorRGB Sample(const Vector2& uv) const
+		ColorRGB Sample(const Vector2& uv, TexcoordDerivatives const& derivatives, Sampler const& sampler) const noexcept
+		{
+			assert(m_TexelFormat == TexelFormat::RGBA8);
+			uint32_t const texel{ SampleTexel(uv, derivatives, sampler) };
+			return { (texel & 0xFF) * NORMALIZE_FACTOR, ((texel >> 8) & 0xFF) * NORMALIZE_FACTOR, ((texel >> 16) & 0xFF) * NORMALIZE_FACTOR };
+		}
+		float SampleAlpha(const Vector2& uv, TexcoordDerivatives const& derivatives, Sampler const& sampler) const noexcept
+		{
+			assert(m_TexelFormat == TexelFormat::RGBA8);
+			return (SampleTexel(uv, derivatives, sampler) >> 24) * NORMALIZE_FACTOR;
+		}
+		// Red channel only, works for both texel formats
+		float SampleRed(const Vector2& uv, TexcoordDerivatives const& derivatives, Sampler const& sampler) const noexcept
+		{
+			return (SampleTexel(uv, derivatives, sampler) & 0xFF) * NORMALIZE_FACTOR;
+		}
+		// Offset in bytes of the level 0 texel a point sample reads from, to measure the memory access pattern of a layout
+		[[nodiscard]] std::size_t GetTexelOffset(const Vector2& uv) const noexcept
+		{
+			MipLevel const& level{ m_Levels[0] };
+			uint32_t const x{ static_cast<uint32_t>((uv.x - std::floor(uv.x)) * level.width) };
+			uint32_t const y{ static_cast<uint32_t>((uv.y - std::floor(uv.y)) * level.height) };
+			return level.offset + std::size_t{ GetTexelIdx(level, std::min(x, level.width - 1), std::min(y, level.height - 1)) } * GetTexelSize();
+		}
+
+		[[nodiscard]] uint32_t GetWidth() const noexcept
+		{
+			return m_Levels[0].width;
+		}
+		[[nodiscard]] uint32_t GetHeight() const noexcept
+		{
+			return m_Levels[0].height;
+		}
+		[[nodiscard]] uint32_t GetNumMipLevels() const noexcept
+		{
+			return static_cast<uint32_t>(m_Levels.size());
+		}
+		[[nodiscard]] TexelLayout GetTexelLayout() const noexcept
 		{
-			uint32_t const x{ static_cast<uint32_t>(uv.x * m_pSurface->w) };
-			uint32_t const y{ static_cast<uint32_t>(uv.y * m_pSurface->h) };
+			return m_TexelLayout;
+		}
+		// Reorders the texels of every mip level, returns false if the texture can not use the layout (Morton needs power of two sizes)
+		[[nodiscard]] bool SetTexelLayout(TexelLayout layout)
+		{
+			if (layout == m_TexelLayout)
+			{
+				return true;
+			}
+			if (layout == TexelLayout::Morton && !m_IsPowerOfTwo)
+			{
+				return false;
+			}
 
-			uint8_t r{};
-			uint8_t g{};
-			uint8_t b{};
-			SDL_GetRGB(m_pSurfacePixels[(y * m_pSurface->w) + x], m_pSurface->format, &r, &g, &b);
-			static constexpr float normalizedFactor{ 1 / 255.f };
-			return { r * normalizedFactor, g * normalizedFactor, b * normalizedFactor };
-		 }
+			uint32_t const texelSize{ GetTexelSize() };
+			TexelStorage pTexels{ AllocateTexels(m_TexelsSize) };
+			for (MipLevel const& level : m_Levels)
+			{
+				for (uint32_t y{ 0 }; y < level.height; ++y)
+				{
+					for (uint32_t x{ 0 }; x < level.width; ++x)
+					{
+						uint32_t const linearIdx{ y * level.width + x };
+						uint32_t const mortonIdx{ GetMortonIdx(level, x, y) };
+						uint32_t const srcIdx{ layout == TexelLayout::Morton ? linearIdx : mortonIdx };
+						uint32_t const dstIdx{ layout == TexelLayout::Morton ? mortonIdx : linearIdx };
+						std::memcpy(pTexels.get() + level.offset + std::size_t{ dstIdx } * texelSize, m_pTexels.get() + level.offset + std::size_t{ srcIdx } * texelSize, texelSize);
+					}
+				}
+			}
+
+			m_pTexels = std::move(pTexels);
+			m_TexelLayout = layout;
+			return true;
+		}
 		
 
 	private:
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		struct MipLevel
+		{
+			uint32_t width{};
+			uint32_t height{};
+			uint32_t mortonBits{}; // Bits of x and y that are interleaved, log2 of the smaller side
+			std::size_t offset{}; // In bytes, from the start of the texels
+		};
+
+		static constexpr std::size_t TEXEL_ALIGNMENT{ 64 }; // Cache line
+
+		// Frees the texels with the alignment they were allocated with
+		struct AlignedDeleter
+		{
+			void operator()(uint8_t* pTexels) const noexcept
+			{
+				::operator delete(pTexels, std::align_val_t{ TEXEL_ALIGNMENT });
+			}
+		};
+		using TexelStorage = std::unique_ptr<uint8_t[], AlignedDeleter>;
+
+		[[nodiscard]] static TexelStorage AllocateTexels(std::size_t size)
+		{
+			return TexelStorage{ static_cast<uint8_t*>(::operator new(size, std::align_val_t{ TEXEL_ALIGNMENT })) };
+		}
+		static constexpr float NORMALIZE_FACTOR{ 1 / 255.f };
+		static constexpr size_t MIP_ROWS_PER_JOB{ 16 };
+
+		[[nodiscard]] uint32_t GetTexelSize() const noexcept
+		{
+			return m_TexelFormat == TexelFormat::RGBA8 ? 4 : 1;
+		}
+
+		// Pixel footprint in level 0 texels: the squared lengths of its longest and shortest side
+		struct Footprint
+		{
+			float majorSquared{};
+			float minorSquared{};
+			Vector2 majorAxis{}; // In uv
+		};
+		Footprint GetFootprint(TexcoordDerivatives const& derivatives) const noexcept
+		{
+			auto const width{ static_cast<float>(GetWidth()) };
+			auto const height{ static_cast<float>(GetHeight()) };
+			float const dxSquared{ Vector2{ derivatives.dx.x * width, derivatives.dx.y * height }.SqrMagnitude() };
+			float const dySquared{ Vector2{ derivatives.dy.x * width, derivatives.dy.y * height }.SqrMagnitude() };
+			if (dxSquared >= dySquared)
+			{
+				return { dxSquared, dySquared, derivatives.dx };
+			}
+			return { dySquared, dxSquared, derivatives.dy };
+		}
+
+		// log2 of a side of the footprint (squared, in level 0 texels), clamped to the mip chain
+		float GetLod(float lengthSquared) const noexcept
+		{
+			// Max with 1 first: magnified pixels use level 0 and a NaN footprint does not end up in the level index
+			return std::min(.5f * std::log2(std::max(1.f, lengthSquared)), static_cast<float>(m_Levels.size() - 1));
+		}
+
+		// Every filter works on the packed texels with 8 bit weights (like the fixed point weights of GPU samplers), so every channel is only decoded once
+		uint32_t SampleTexel(const Vector2& uv, TexcoordDerivatives const& derivatives, Sampler const& sampler) const noexcept
+		{
+			Footprint const footprint{ GetFootprint(derivatives) };
+			switch (sampler.filter)
+			{
+			case SamplerState::Point:
+			{
+				// MIN_MAG_MIP_POINT: nearest texel of the nearest level
+				auto const levelIdx{ static_cast<uint32_t>(GetLod(footprint.majorSquared) + .5f) };
+				return SamplePoint(m_Levels[levelIdx], uv, sampler.address);
+			}
+			case SamplerState::Anisotropic:
+			{
+				// Several trilinear taps spread along the longest side of the footprint, each one only as blurry as the shortest side.
+				// Cheap compared to a real (elliptical) footprint, but it keeps surfaces at grazing angles sharp.
+				float const ratio{ std::sqrt(footprint.majorSquared / std::max(footprint.minorSquared, 1e-8f)) };
+				if (!(ratio > 1.f)) // Also catches a NaN footprint
+				{
+					return SampleTrilinear(uv, GetLod(footprint.majorSquared), sampler.address);
+				}
+				auto const numTaps{ static_cast<uint32_t>(std::min(std::ceil(ratio), static_cast<float>(std::max(sampler.maxAnisotropy, 1u)))) };
+
+				float const lod{ GetLod(footprint.majorSquared / static_cast<float>(numTaps * numTaps)) };
+				uint32_t sums[4]{};
+				for (uint32_t tap{ 0 }; tap < numTaps; ++tap)
+				{
+					float const offset{ (static_cast<float>(tap) + .5f) / static_cast<float>(numTaps) - .5f };
+					uint32_t const texel{ SampleTrilinear(uv + footprint.majorAxis * offset, lod, sampler.address) };
+					for (uint32_t channel{ 0 }; channel < 4; ++channel)
+					{
+						sums[channel] += (texel >> (channel * 8)) & 0xFF;
+					}
+				}
+
+				uint32_t texel{ 0 };
+				for (uint32_t channel{ 0 }; channel < 4; ++channel)
+				{
+					texel |= ((sums[channel] + numTaps / 2) / numTaps) << (channel * 8);
+				}
+				return texel;
+			}
+			case SamplerState::Linear:
+			default:
+				return SampleTrilinear(uv, GetLod(footprint.majorSquared), sampler.address);
+			}
+		}
+
+		// MIN_MAG_MIP_LINEAR: bilinear in the two levels around the lod, blended between them
+		uint32_t SampleTrilinear(const Vector2& uv, float lod, AddressMode address) const noexcept
+		{
+			auto const levelIdx{ static_cast<uint32_t>(lod) };
+			auto const blend{ static_cast<uint32_t>((lod - static_cast<float>(levelIdx)) * 256.f) };
+
+			uint32_t const texel{ SampleBilinear(m_Levels[levelIdx], uv, address) };
+			if (blend == 0)
+			{
+				return texel;
+			}
+			return LerpPackedColor(texel, SampleBilinear(m_Levels[levelIdx + 1], uv, address), blend);
+		}
+
+		uint32_t SampleBilinear(MipLevel const& level, const Vector2& uv, AddressMode address) const noexcept
+		{
+			// Texel centers are at .5, the texels around the sample wrap around or clamp to the edges
+			float const x{ GetTexelPosition(uv.x, level.width, address) - .5f };
+			float const y{ GetTexelPosition(uv.y, level.height, address) - .5f };
+			float const floorX{ std::floor(x) };
+			float const floorY{ std::floor(y) };
+			auto const weightX{ static_cast<uint32_t>((x - floorX) * 256.f) };
+			auto const weightY{ static_cast<uint32_t>((y - floorY) * 256.f) };
+
+			uint32_t const x0{ GetAddress(static_cast<int>(floorX), level.width, address) };
+			uint32_t const y0{ GetAddress(static_cast<int>(floorY), level.height, address) };
+			uint32_t const x1{ GetAddress(static_cast<int>(floorX) + 1, level.width, address) };
+			uint32_t const y1{ GetAddress(static_cast<int>(floorY) + 1, level.height, address) };
+
+			return simd::BilinearPacked(GetTexel(level, x0, y0), GetTexel(level, x1, y0), GetTexel(level, x0, y1), GetTexel(level, x1, y1), weightX, weightY);
+		}
+
+		uint32_t SamplePoint(MipLevel const& level, const Vector2& uv, AddressMode address) const noexcept
+		{
+			// Rounding can push a uv just below 1 onto the texel past the edge, GetAddress brings it back
+			uint32_t const x{ GetAddress(static_cast<int>(GetTexelPosition(uv.x, level.width, address)), level.width, address) };
+			uint32_t const y{ GetAddress(static_cast<int>(GetTexelPosition(uv.y, level.height, address)), level.height, address) };
+			return GetTexel(level, x, y);
+		}
+
+		// Texture coordinate to a position in texels, in [0, size].
+		// Wrapped coordinates are brought into [0, 1) before scaling, so the position keeps its precision (and fits an int) however far the uv tiles.
+		static float GetTexelPosition(float coordinate, uint32_t size, AddressMode address) noexcept
+		{
+			float const reduced{ address == AddressMode::Clamp ? std::clamp(coordinate, 0.f, 1.f) : coordinate - std::floor(coordinate) };
+			return reduced * static_cast<float>(size);
+		}
+
+		// R8 texels end up in the lowest byte
+		uint32_t GetTexel(MipLevel const& level, uint32_t x, uint32_t y) const noexcept
+		{
+			uint8_t const* const pLevel{ m_pTexels.get() + level.offset };
+			if (m_TexelFormat == TexelFormat::RGBA8)
+			{
+				uint32_t texel;
+				std::memcpy(&texel, pLevel + std::size_t{ GetTexelIdx(level, x, y) } * 4, sizeof(texel));
+				return texel;
+			}
+			return pLevel[GetTexelIdx(level, x, y)];
+		}
+
+		// Coordinates are at most one texel outside of the level
+		uint32_t GetAddress(int coordinate, uint32_t size, AddressMode address) const noexcept
+		{
+			if (address == AddressMode::Clamp)
+			{
+				return static_cast<uint32_t>(std::clamp(coordinate, 0, static_cast<int>(size) - 1));
+			}
+			if (m_IsPowerOfTwo)
+			{
+				return static_cast<uint32_t>(coordinate) & (size - 1); // Two's complement, so this wraps negative coordinates as well
+			}
+			auto const signedSize{ static_cast<int>(size) };
+			return static_cast<uint32_t>(coordinate < 0 ? coordinate + signedSize : (coordinate >= signedSize ? coordinate - signedSize : coordinate));
+		}
+
+		uint32_t GetTexelIdx(MipLevel const& level, uint32_t x, uint32_t y) const noexcept
+		{
+			return m_TexelLayout == TexelLayout::Morton ? GetMortonIdx(level, x, y) : y * level.width + x;
+		}
+
+		// Interleaves the bits of x and y as far as the smaller side goes, the rest of the larger side is stacked on top.
+		// A 64 byte cache line holds a 4x4 block of RGBA8 texels, or an 8x8 block of R8 texels.
+		static uint32_t GetMortonIdx(MipLevel const& level, uint32_t x, uint32_t y) noexcept
+		{
+			uint32_t const mask{ (1u << level.mortonBits) - 1 };
+			return SpreadBits(x & mask) | (SpreadBits(y & mask) << 1) | (((x | y) >> level.mortonBits) << (2 * level.mortonBits));
+		}
+		// Inserts a zero bit above every bit of the lower 16 bits
+		static uint32_t SpreadBits(uint32_t v) noexcept
+		{
+#if defined(__BMI2__)
+			return _pdep_u32(v, 0x55555555);
+#else
+			v = (v | (v << 8)) & 0x00FF00FF;
+			v = (v | (v << 4)) & 0x0F0F0F0F;
+			v = (v | (v << 2)) & 0x33333333;
+			return (v | (v << 1)) & 0x55555555;
+#endif
+		}
+
+		// Source texels of one destination texel along one side, and how much of each it covers
+		struct MipTaps
+		{
+			uint32_t first{};
+			uint32_t count{};
+			float weights[3]{};
+		};
+		// Even sides average 2 texels. On odd sides a destination texel covers 2 + 1 / dstSize texels, spread over 3 weighted taps
+		// (the way D3DX and stb filter non power of two mips), so the last row / column is not dropped.
+		static std::vector<MipTaps> GetMipTaps(uint32_t srcSize, uint32_t dstSize)
+		{
+			std::vector<MipTaps> taps(dstSize);
+			for (uint32_t i{ 0 }; i < dstSize; ++i)
+			{
+				if (srcSize == 1)
+				{
+					taps[i] = { 0, 1, { 1.f } };
+				}
+				else if (srcSize % 2 == 0)
+				{
+					taps[i] = { 2 * i, 2, { .5f, .5f } };
+				}
+				else
+				{
+					auto const size{ static_cast<float>(srcSize) };
+					taps[i] = { 2 * i, 3, { static_cast<float>(dstSize - i) / size, static_cast<float>(dstSize) / size, static_cast<float>(i + 1) / size } };
+				}
+			}
+			return taps;
+		}
+
+		// Box filter, down to 1x1: every texel is the average of the texels it covers in the level above (see GetMipTaps).
+		// The rows of a level are split over the job system.
+		static std::vector<std::vector<uint32_t>> GenerateMips(SDL_Surface const* pSurface, JobSystem& jobSystem)
+		{
+			auto width{ static_cast<uint32_t>(pSurface->w) };
+			auto height{ static_cast<uint32_t>(pSurface->h) };
+
+			std::vector<std::vector<uint32_t>> mips{};
+			mips.emplace_back(std::size_t{ width } * height);
+			for (uint32_t y{ 0 }; y < height; ++y)
+			{
+				std::memcpy(mips[0].data() + y * width, static_cast<uint8_t const*>(pSurface->pixels) + y * pSurface->pitch, width * sizeof(uint32_t));
+			}
+
+			while (width > 1 || height > 1)
+			{
+				uint32_t const srcWidth{ width };
+				uint32_t const srcHeight{ height };
+				width = std::max(width / 2, 1u);
+				height = std::max(height / 2, 1u);
+
+				std::vector<MipTaps> const columnTaps{ GetMipTaps(srcWidth, width) };
+				std::vector<MipTaps> const rowTaps{ GetMipTaps(srcHeight, height) };
+				std::vector<uint32_t> mip(std::size_t{ width } * height);
+				uint32_t const* const pSrc{ mips.back().data() };
+				jobSystem.ParallelFor(height, MIP_ROWS_PER_JOB, [&](size_t first, size_t last)
+					{
+						for (auto y{ static_cast<uint32_t>(first) }; y < last; ++y)
+						{
+							MipTaps const& tapsY{ rowTaps[y] };
+							for (uint32_t x{ 0 }; x < width; ++x)
+							{
+								MipTaps const& tapsX{ columnTaps[x] };
+
+								float sums[4]{};
+								for (uint32_t ty{ 0 }; ty < tapsY.count; ++ty)
+								{
+									uint32_t const* const pRow{ pSrc + std::size_t{ tapsY.first + ty } * srcWidth };
+									for (uint32_t tx{ 0 }; tx < tapsX.count; ++tx)
+									{
+										float const weight{ tapsY.weights[ty] * tapsX.weights[tx] };
+										uint32_t const srcTexel{ pRow[tapsX.first + tx] };
+										for (uint32_t channel{ 0 }; channel < 4; ++channel)
+										{
+											sums[channel] += weight * static_cast<float>((srcTexel >> (channel * 8)) & 0xFF);
+										}
+									}
+								}
+
+								uint32_t texel{ 0 };
+								for (uint32_t channel{ 0 }; channel < 4; ++channel)
+								{
+									// + .5 rounds to the nearest value
+									texel |= std::min(static_cast<uint32_t>(sums[channel] + .5f), 255u) << (channel * 8);
+								}
+								mip[std::size_t{ y } * width + x] = texel;
+							}
+						}
+					});
+				mips.emplace_back(std::move(mip));
+			}
+			return mips;
+		}
+
+		// Copies every level in the texel format, in the linear layout, each level starting on its own cache line
+		void CreateTexels(std::vector<std::vector<uint32_t>> const& mips, uint32_t width, uint32_t height)
+		{
+			uint32_t const texelSize{ GetTexelSize() };
+			m_TexelsSize = 0;
+			for (size_t i{ 0 }; i < mips.size(); ++i)
+			{
+				m_Levels.push_back({ width, height, static_cast<uint32_t>(std::countr_zero(std::min(width, height))), m_TexelsSize });
+				m_TexelsSize += (std::size_t{ width } * height * texelSize + TEXEL_ALIGNMENT - 1) & ~(TEXEL_ALIGNMENT - 1);
+				width = std::max(width / 2, 1u);
+				height = std::max(height / 2, 1u);
+			}
+
+			m_pTexels = AllocateTexels(m_TexelsSize);
+			for (size_t i{ 0 }; i < mips.size(); ++i)
+			{
+				uint8_t* const pLevel{ m_pTexels.get() + m_Levels[i].offset };
+				if (m_TexelFormat == TexelFormat::RGBA8)
+				{
+					std::memcpy(pLevel, mips[i].data(), mips[i].size() * sizeof(uint32_t));
+					continue;
+				}
+
+				for (size_t t{ 0 }; t < mips[i].size(); ++t)
+				{
+					pLevel[t] = static_cast<uint8_t>(mips[i][t] & 0xFF);
+				}
+			}
+		}
+
+		std::vector<MipLevel> m_Levels{};
+		TexelStorage m_pTexels{}; // Tightly packed levels, rgba byte order for RGBA8
+		std::size_t m_TexelsSize{};
+		TexelFormat m_TexelFormat{};
+		TexelLayout m_TexelLayout{ TexelLayout::Linear };
+		bool m_IsPowerOfTwo{}; // Both sides, so every level as well and wrapping is a mask
 
 		ID3D11Texture2D* m_pResource{};
 		ID3D11ShaderResourceView* m_pShaderResourceView{};
 	};
 }
-
@@ -0,0 +1,203 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "MathHelpers.h"
+#include "Vertex_In.h"
+
+namespace dae
+{
+	class Mesh;
+
+	// Vertices are snapped to 16.8 fixed point before rasterization
+	int constexpr SUBPIXEL_BITS{ 8 };
+	int constexpr SUBPIXEL_STEPS{ 1 << SUBPIXEL_BITS };
+
+	// 4x MSAA, the standard D3D sample pattern (rotated grid) in 16.8 fixed point, relative to the pixel center
+	int constexpr MSAA_SAMPLES{ 4 };
+	int constexpr MSAA_SAMPLE_POSITIONS[MSAA_SAMPLES][2]{ { -32, -96 }, { 96, -32 }, { -96, 32 }, { 32, 96 } };
+	int constexpr MSAA_SAMPLE_REACH{ 96 }; // Furthest any sample lies from the center, along x or y
+
+	// Integer edge function evaluated at pixel centers: E(px, py) = stepX * px + stepY * py + offset
+	// A pixel is covered when E >= 0 for all three edges, the top-left fill rule is already folded into the offset.
+	struct EdgeFunction
+	{
+		int64_t stepX{};
+		int64_t stepY{};
+		int64_t offset{};
+		float remainder{}; // Precision dropped from the offset, E + remainder is the exact distance used for the barycentric weights
+		int32_t sampleOffsets[MSAA_SAMPLES]{}; // E + sampleOffsets[s] is the edge function at MSAA sample s, with the same fill rule
+
+		[[nodiscard]] int64_t Evaluate(int px, int py) const noexcept
+		{
+			return stepX * px + stepY * py + offset;
+		}
+	};
+
+	// Edge from a to b (16.8 fixed point), positive on the inside of a triangle with a positive area
+	[[nodiscard]] inline EdgeFunction CreateEdgeFunction(Int2 const& a, Int2 const& b) noexcept
+	{
+		EdgeFunction edge{};
+		edge.stepX = static_cast<int64_t>(a.y) - b.y;
+		edge.stepY = static_cast<int64_t>(b.x) - a.x;
+		int64_t const c{ static_cast<int64_t>(a.x) * b.y - static_cast<int64_t>(a.y) * b.x };
+
+		// Top-left rule: a pixel center exactly on an edge only belongs to the triangle when it is a top or a left edge
+		bool const isTopLeft{ edge.stepX > 0 || (edge.stepX == 0 && edge.stepY > 0) };
+
+		// Move the origin to the pixel center and drop the subpixel precision of the result.
+		// The shift is a floor division, so "E >= 0" gives exactly the same answer as the full precision test.
+		int64_t const centerOffset{ c + (edge.stepX + edge.stepY) * (SUBPIXEL_STEPS / 2) };
+		edge.offset = (centerOffset - (isTopLeft ? 0 : 1)) >> SUBPIXEL_BITS;
+		edge.remainder = static_cast<float>(centerOffset - edge.offset * SUBPIXEL_STEPS) / SUBPIXEL_STEPS;
+
+		// Same thing with the origin moved to every sample instead of the pixel center
+		for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+		{
+			int64_t const sampleOffset{ centerOffset + edge.stepX * MSAA_SAMPLE_POSITIONS[s][0] + edge.stepY * MSAA_SAMPLE_POSITIONS[s][1] };
+			edge.sampleOffsets[s] = static_cast<int32_t>(((sampleOffset - (isTopLeft ? 0 : 1)) >> SUBPIXEL_BITS) - edge.offset);
+		}
+		return edge;
+	}
+
+	// Attribute as a plane in barycentric space: value = base + weight1 * d1 + weight2 * d2
+	// Only needs the weights of vertex 1 and 2, so every interpolation is two multiply-adds
+	template<typename T>
+	struct AttributePlane
+	{
+		T base{};
+		T d1{};
+		T d2{};
+
+		[[nodiscard]] T Interpolate(float weight1, float weight2) const noexcept
+		{
+			return base + weight1 * d1 + weight2 * d2;
+		}
+	};
+
+	template<typename T>
+	[[nodiscard]] AttributePlane<T> CreateAttributePlane(T const& a0, T const& a1, T const& a2) noexcept
+	{
+		return { a0, a1 - a0, a2 - a0 };
+	}
+
+	// Loop a triangle is rasterized with, picked from its bounding box during setup
+	enum class RasterMethod : uint8_t
+	{
+		Tiny, // A handful of pixel centers, tested one by one without any SIMD or block setup
+		Block, // SIMD over 8x8 blocks of the bounding box, with a hierarchical depth test per block
+		Span, // Large triangles: SIMD over the exact covered span of every row, skips the empty half of the bounding box
+		Scalar, // Edge functions don't fit in 32 bit lanes (a vertex far off-screen), one pixel at a time in 64 bit
+
+		COUNT
+	};
+
+	// Everything the rasterizer needs from a triangle, gathered once during setup and then shared (read-only) by every tile it overlaps
+	struct TriangleSetup
+	{
+		Mesh const* pMesh{ nullptr }; // nullptr when the triangle got culled during setup (or still has to be clipped)
+
+		// Only used for triangles that still have to be clipped, everything else is stored in the attribute planes
+		uint32_t vertexIndices[3]{};
+		uint8_t clipPlanes{}; // Planes this triangle has to be clipped against before it can be set up (Utils::ClipPlane)
+
+		// edges[i] is the edge opposite of vertex i, so it doubles as the (unnormalized) barycentric weight of that vertex
+		EdgeFunction edges[3]{};
+		float invArea{};
+		float minDepth{}; // Smallest depth of the three vertices, nothing of the triangle can be closer than this
+
+		// NDC depth is linear in screen space, everything else is perspective-correct: divided by w here, multiplied with the interpolated w per pixel
+		AttributePlane<float> depth{};
+		AttributePlane<float> invW{};
+		AttributePlane<Vector2> texcoord{};
+		AttributePlane<Vector3> normal{};
+		AttributePlane<Vector3> tangent{};
+		AttributePlane<Vector3> worldPosition{};
+
+		// Pixel bounding box [min, max), clamped to the screen
+		int minX{};
+		int minY{};
+		int maxX{};
+		int maxY{};
+
+		RasterMethod rasterMethod{};
+	};
+
+	// How the barycentric weights and the depth change from the pixel center to every MSAA sample, the same for the whole triangle
+	struct SampleDeltas
+	{
+		float weight1[MSAA_SAMPLES]{};
+		float weight2[MSAA_SAMPLES]{};
+		float depth[MSAA_SAMPLES]{};
+	};
+
+	[[nodiscard]] inline SampleDeltas CreateSampleDeltas(TriangleSetup const& triangle) noexcept
+	{
+		// The edge functions step stepX per pixel, the sample positions are in subpixels
+		float const scale{ triangle.invArea / SUBPIXEL_STEPS };
+		SampleDeltas deltas{};
+		for (int s{ 0 }; s < MSAA_SAMPLES; ++s)
+		{
+			int64_t const sx{ MSAA_SAMPLE_POSITIONS[s][0] };
+			int64_t const sy{ MSAA_SAMPLE_POSITIONS[s][1] };
+			deltas.weight1[s] = static_cast<float>(triangle.edges[1].stepX * sx + triangle.edges[1].stepY * sy) * scale;
+			deltas.weight2[s] = static_cast<float>(triangle.edges[2].stepX * sx + triangle.edges[2].stepY * sy) * scale;
+			deltas.depth[s] = deltas.weight1[s] * triangle.depth.d1 + deltas.weight2[s] * triangle.depth.d2;
+		}
+		return deltas;
+	}
+
+	// What the visibility buffer stores per pixel, the mesh and vertices come from the triangle setup and the depth from the depth buffer
+	struct VisibilityTexel
+	{
+		uint32_t triangleIdx{}; // Index into the triangle setup list, INVALID_TRIANGLE when nothing covers the pixel
+		float weight1{};
+		float weight2{}; // weight0 is 1 - weight1 - weight2
+	};
+	uint32_t constexpr INVALID_TRIANGLE{ UINT32_MAX };
+
+	// Variable rate shading: how many pixels share one shaded color, picked per rate tile of the screen
+	enum class ShadingRate : uint8_t
+	{
+		Rate1x1,
+		Rate1x2, // 1 wide, 2 high: for content that only changes horizontally
+		Rate2x2,
+		Rate4x4,
+
+		COUNT
+	};
+	int constexpr RATE_TILE_SIZE{ 16 }; // Pixels along each side of a rate tile, coarse pixels never cross one
+	int constexpr MAX_COARSE_PIXELS_PER_RATE_TILE{ RATE_TILE_SIZE * RATE_TILE_SIZE / 2 };
+
+	[[nodiscard]] constexpr int GetShadingRateWidth(ShadingRate rate) noexcept
+	{
+		return rate == ShadingRate::Rate4x4 ? 4 : rate == ShadingRate::Rate2x2 ? 2 : 1;
+	}
+	[[nodiscard]] constexpr int GetShadingRateHeight(ShadingRate rate) noexcept
+	{
+		return rate == ShadingRate::Rate4x4 ? 4 : rate == ShadingRate::Rate1x1 ? 1 : 2;
+	}
+
+	// The triangle that was shaded last for a coarse pixel, and the color the rest of its pixels reuse
+	struct CoarseShade
+	{
+		uint32_t triangleIdx{ INVALID_TRIANGLE };
+		uint32_t color{};
+	};
+
+	// Screen tile, only ever rasterized by a single thread so it can write its part of the buffers without synchronization
+	struct Tile
+	{
+		int minX{};
+		int minY{};
+		int maxX{};
+		int maxY{};
+
+		// Indices into the triangle setup list, in submission order
+		std::vector<uint32_t> triangles{};
+		// Same, for the transparent triangles, back to front
+		std::vector<uint32_t> transparentTriangles{};
+
+		uint32_t shadedFragments{}; // PixelShading calls for this tile during the last frame
+	};
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <fstream>
+#include <unordered_map>
 #include "Math.h"
 #include "Mesh.h"
 
@@ -32,30 +33,113 @@ namespace dae
 			return true;
 		}
 
-		// Checks if at least one part of triangle is outside frustum
-		[[nodiscard]] inline bool IsTriangleOutsideFrustum(Mesh const* mesh, uint32_t idx1, uint32_t idx2, uint32_t idx3) noexcept
+		// Clip space planes (D3D convention: -w <= x, y <= w and 0 <= z <= w), used as bit masks
+		enum ClipPlane : uint8_t
 		{
-			const auto& v1 = mesh->GetVertices_Out()[idx1].position;
-			const auto& v2 = mesh->GetVertices_Out()[idx2].position;
-			const auto& v3 = mesh->GetVertices_Out()[idx3].position;
-
-			// Check all vertices against each frustum plane
-			if (v1.z < 0 && v2.z < 0 && v3.z < 0)
+			Near = 1 << 0,
+			Far = 1 << 1,
+			Left = 1 << 2,
+			Right = 1 << 3,
+			Bottom = 1 << 4,
+			Top = 1 << 5
+		};
+
+		// Triangles within the guard band (in NDC units) are rasterized as is and rely on the bounding box clamp,
+		// only the ones reaching further out get clipped against it. Keeps the 16.8 fixed point coordinates in range.
+		float constexpr GUARD_BAND{ 8.f };
+
+		// A polygon clipped against 5 planes (near + the guard band sides) can gain one vertex per plane
+		int constexpr MAX_CLIPPED_VERTICES{ 3 + 5 };
+
+		// Signed distance to a plane, the inside is positive. guardBand scales the side planes
+		[[nodiscard]] inline float GetPlaneDistance(Vector4 const& p, ClipPlane plane, float guardBand) noexcept
+		{
+			switch (plane)
 			{
-				return true;
+			case Near: return p.z;
+			case Far: return p.w - p.z;
+			case Left: return p.x + guardBand * p.w;
+			case Right: return guardBand * p.w - p.x;
+			case Bottom: return p.y + guardBand * p.w;
+			case Top: return guardBand * p.w - p.y;
+			default: return 0.f;
 			}
-			if (v1.z > 1 && v2.z > 1 && v3.z > 1)
+		}
+
+		// All planes (scaled by guardBand) the point lies outside of
+		[[nodiscard]] inline uint8_t GetOutsidePlanes(Vector4 const& p, float guardBand) noexcept
+		{
+			uint8_t outside{ 0 };
+			for (uint8_t plane{ Near }; plane <= Top; plane <<= 1)
 			{
-				return true;
+				if (GetPlaneDistance(p, static_cast<ClipPlane>(plane), guardBand) < 0.f)
+				{
+					outside |= plane;
+				}
 			}
+			return outside;
+		}
+
+		// Only true when the whole triangle is on the outside of a single frustum plane, everything else is (partially) visible
+		[[nodiscard]] inline bool IsTriangleOutsideFrustum(Vector4 const& v1, Vector4 const& v2, Vector4 const& v3) noexcept
+		{
+			return (GetOutsidePlanes(v1, 1.f) & GetOutsidePlanes(v2, 1.f) & GetOutsidePlanes(v3, 1.f)) != 0;
+		}
+
+		// Planes the triangle still has to be clipped against before it can be rasterized: the near plane and the guard band
+		[[nodiscard]] inline uint8_t GetTriangleClipPlanes(Vector4 const& v1, Vector4 const& v2, Vector4 const& v3) noexcept
+		{
+			uint8_t const outside{ static_cast<uint8_t>(GetOutsidePlanes(v1, GUARD_BAND) | GetOutsidePlanes(v2, GUARD_BAND) | GetOutsidePlanes(v3, GUARD_BAND)) };
+			return outside & ~Far; // The depth test takes care of the far plane
+		}
+
+		// Clip space interpolation, which is still linear for every attribute
+		[[nodiscard]] inline Vertex_Out LerpVertex(Vertex_Out const& a, Vertex_Out const& b, float t) noexcept
+		{
+			Vertex_Out v{};
+			v.position = a.position + (b.position - a.position) * t;
+			v.texcoord = a.texcoord + (b.texcoord - a.texcoord) * t;
+			v.normal = a.normal + (b.normal - a.normal) * t;
+			v.tangent = a.tangent + (b.tangent - a.tangent) * t;
+			v.worldPosition = a.worldPosition + (b.worldPosition - a.worldPosition) * t;
+			return v;
+		}
 
-			for (int i = 0; i < 2; ++i)
+		// Sutherland-Hodgman clipping of a convex polygon against every plane in the mask.
+		// polygon needs room for MAX_CLIPPED_VERTICES, returns the new vertex count (less than 3 means nothing is left)
+		[[nodiscard]] inline int ClipPolygon(Vertex_Out* polygon, int count, uint8_t planes) noexcept
+		{
+			Vertex_Out input[MAX_CLIPPED_VERTICES]{};
+			for (uint8_t plane{ Near }; plane <= Top && count >= 3; plane <<= 1)
 			{
-				if ((v1[i] > 1.f || v1[i] < -1.f) || (v2[i] > 1.f || v2[i] < -1.f) || (v3[i] > 1.f || v3[i] < -1.f))
-					return true;
-			}
+				if (!(planes & plane))
+				{
+					continue;
+				}
+
+				std::copy_n(polygon, count, input);
+				int const inputCount{ count };
+				count = 0;
+
+				for (int i{ 0 }; i < inputCount; ++i)
+				{
+					Vertex_Out const& curr{ input[i] };
+					Vertex_Out const& next{ input[(i + 1) % inputCount] };
+					float const currDistance{ GetPlaneDistance(curr.position, static_cast<ClipPlane>(plane), GUARD_BAND) };
+					float const nextDistance{ GetPlaneDistance(next.position, static_cast<ClipPlane>(plane), GUARD_BAND) };
 
-			return false;
+					if (currDistance >= 0.f)
+					{
+						polygon[count++] = curr;
+					}
+					// Edge crosses the plane, add the intersection
+					if ((currDistance >= 0.f) != (nextDistance >= 0.f))
+					{
+						polygon[count++] = LerpVertex(curr, next, currDistance / (currDistance - nextDistance));
+					}
+				}
+			}
+			return count;
 		}
 
 		[[nodiscard]] constexpr float DepthRemap(float v, float min, float max) noexcept
@@ -68,6 +152,49 @@ namespace dae
 			return normalizedValue;
 		}
 
+		// Stable LSD radix sort on 32 bit keys, 8 bits per pass, values are moved along with their keys.
+		// The scratch vectors only exist so repeated sorts don't allocate, their contents don't matter.
+		inline void RadixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, std::vector<uint32_t>& keysScratch, std::vector<uint32_t>& valuesScratch)
+		{
+			assert(keys.size() == values.size());
+			if (keys.empty())
+			{
+				return;
+			}
+			keysScratch.resize(keys.size());
+			valuesScratch.resize(values.size());
+
+			for (uint32_t shift{ 0 }; shift < 32; shift += 8)
+			{
+				size_t offsets[256]{};
+				for (uint32_t const key : keys)
+				{
+					++offsets[(key >> shift) & 0xFF];
+				}
+				// Every key has the same byte here, this pass would not move anything
+				if (offsets[(keys[0] >> shift) & 0xFF] == keys.size())
+				{
+					continue;
+				}
+
+				size_t sum{ 0 };
+				for (size_t& offset : offsets)
+				{
+					size_t const count{ offset };
+					offset = sum;
+					sum += count;
+				}
+				for (size_t i{ 0 }; i < keys.size(); ++i)
+				{
+					size_t const dst{ offsets[(keys[i] >> shift) & 0xFF]++ };
+					keysScratch[dst] = keys[i];
+					valuesScratch[dst] = values[i];
+				}
+				keys.swap(keysScratch);
+				values.swap(valuesScratch);
+			}
+		}
+
 
 		//Just parses vertices and indices
 #pragma warning(push)
@@ -85,6 +212,28 @@ namespace dae
 			vertices.clear();
 			indices.clear();
 
+			// Face corners that use the same position, uv and normal become the same vertex
+			struct CornerKey
+			{
+				size_t position{};
+				size_t texcoord{};
+				size_t normal{};
+
+				bool operator==(CornerKey const& other) const noexcept
+				{
+					return position == other.position && texcoord == other.texcoord && normal == other.normal;
+				}
+			};
+			struct CornerKeyHash
+			{
+				size_t operator()(CornerKey const& key) const noexcept
+				{
+					size_t const hash{ std::hash<size_t>{}(key.position) };
+					return (hash ^ (key.texcoord * 0x9E3779B97F4A7C15ull)) + (key.normal * 0xC2B2AE3D27D4EB4Full);
+				}
+			};
+			std::unordered_map<CornerKey, uint32_t, CornerKeyHash> uniqueVertices{};
+
 			std::string sCommand;
 			// start a while iteration ending when the end of file is reached (ios::eof)
 			while (!file.eof())
@@ -127,12 +276,12 @@ namespace dae
 					//add the material index as attibute to the attribute array
 					//
 					// Faces or triangles
-					Vertex_In vertex{};
-					size_t iPosition, iTexCoord, iNormal;
-
 					uint32_t tempIndices[3];
 					for (size_t iFace = 0; iFace < 3; iFace++)
 					{
+						Vertex_In vertex{};
+						size_t iPosition{}, iTexCoord{}, iNormal{};
+
 						// OBJ format uses 1-based arrays
 						file >> iPosition;
 						vertex.position = positions[iPosition - 1];
@@ -158,9 +307,13 @@ namespace dae
 							}
 						}
 
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
-						//indices.push_back(uint32_t(vertices.size()) - 1);
+						// Reuse the vertex when this corner was seen before, the tangents then get accumulated on the shared vertex
+						auto const [it, isNew] { uniqueVertices.try_emplace(CornerKey{ iPosition, iTexCoord, iNormal }, uint32_t(vertices.size())) };
+						if (isNew)
+						{
+							vertices.push_back(vertex);
+						}
+						tempIndices[iFace] = it->second;
 					}
 
 					indices.push_back(tempIndices[0]);
@@ -197,7 +350,13 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+				// Degenerate uvs have no tangent direction. Skip them, the vertices are shared so 1 / 0 would spread to every triangle around them
+				const float uvCross = Vector2::Cross(diffX, diffY);
+				if (std::abs(uvCross) < FLT_EPSILON)
+				{
+					continue;
+				}
+				float r = 1.f / uvCross;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].tangent += tangent;
@@ -208,7 +367,13 @@ namespace dae
 			//Create the Tangents (reject)
 			for (auto& v : vertices)
 			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+				v.tangent = Vector3::Reject(v.tangent, v.normal);
+				if (v.tangent.SqrMagnitude() < FLT_EPSILON)
+				{
+					// Only degenerate uvs around this vertex, any direction in the surface will do
+					v.tangent = Vector3::Reject(std::abs(v.normal.x) < 0.9f ? Vector3::UnitX : Vector3::UnitY, v.normal);
+				}
+				v.tangent.Normalize();
 
 				if (flipAxisAndWinding)
 				{
@@ -0,0 +1,132 @@
+#pragma once
+#include <vector>
+
+#include "SIMD.h"
+#include "Vertex_In.h"
+
+namespace dae
+{
+	// A vertex after the perspective divide and the viewport transform, with everything triangle setup needs
+	struct ProjectedVertex
+	{
+		Vector2 screenPosition{};
+		float depth{};
+		float invW{};
+		Vector2 texcoord{};
+		Vector3 normal{};
+		Vector3 tangent{};
+		Vector3 worldPosition{};
+	};
+
+	// Vertices split up per component (structure of arrays) so the software vertex stage can load simd::WIDTH vertices per instruction.
+	// Arrays are padded to a multiple of simd::WIDTH, indices never point into the padding.
+	struct VertexInputStream
+	{
+		VertexInputStream() = default;
+		explicit VertexInputStream(std::vector<Vertex_In> const& vertices)
+		{
+			count = vertices.size();
+			size_t const paddedCount{ (count + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH };
+			for (auto* pComponent : { &positionX, &positionY, &positionZ, &texcoordU, &texcoordV, &normalX, &normalY, &normalZ, &tangentX, &tangentY, &tangentZ })
+			{
+				pComponent->resize(paddedCount);
+			}
+
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				Vertex_In const& v{ vertices[i] };
+				positionX[i] = v.position.x;
+				positionY[i] = v.position.y;
+				positionZ[i] = v.position.z;
+				texcoordU[i] = v.texcoord.x;
+				texcoordV[i] = v.texcoord.y;
+				normalX[i] = v.normal.x;
+				normalY[i] = v.normal.y;
+				normalZ[i] = v.normal.z;
+				tangentX[i] = v.tangent.x;
+				tangentY[i] = v.tangent.y;
+				tangentZ[i] = v.tangent.z;
+			}
+		}
+
+		size_t count{};
+
+		std::vector<float> positionX{};
+		std::vector<float> positionY{};
+		std::vector<float> positionZ{};
+		std::vector<float> texcoordU{};
+		std::vector<float> texcoordV{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+	};
+
+	// Result of the software vertex stage, texcoords are not transformed so they stay in the input stream
+	struct VertexOutputStream
+	{
+		void Resize(size_t paddedCount)
+		{
+			for (auto* pComponent : { &clipX, &clipY, &clipZ, &clipW, &screenX, &screenY, &depth, &invW,
+									  &normalX, &normalY, &normalZ, &tangentX, &tangentY, &tangentZ, &worldX, &worldY, &worldZ })
+			{
+				pComponent->resize(paddedCount);
+			}
+		}
+
+		// Clip space position, still needed for culling and clipping
+		[[nodiscard]] Vector4 GetClipPosition(size_t i) const noexcept
+		{
+			return { clipX[i], clipY[i], clipZ[i], clipW[i] };
+		}
+
+		// Gathers a single vertex again, only used for the few triangles that have to be clipped
+		[[nodiscard]] Vertex_Out GetVertex(VertexInputStream const& input, size_t i) const noexcept
+		{
+			Vertex_Out v{};
+			v.position = GetClipPosition(i);
+			v.texcoord = { input.texcoordU[i], input.texcoordV[i] };
+			v.normal = { normalX[i], normalY[i], normalZ[i] };
+			v.tangent = { tangentX[i], tangentY[i], tangentZ[i] };
+			v.worldPosition = { worldX[i], worldY[i], worldZ[i] };
+			return v;
+		}
+
+		[[nodiscard]] ProjectedVertex GetProjectedVertex(VertexInputStream const& input, size_t i) const noexcept
+		{
+			ProjectedVertex v{};
+			v.screenPosition = { screenX[i], screenY[i] };
+			v.depth = depth[i];
+			v.invW = invW[i];
+			v.texcoord = { input.texcoordU[i], input.texcoordV[i] };
+			v.normal = { normalX[i], normalY[i], normalZ[i] };
+			v.tangent = { tangentX[i], tangentY[i], tangentZ[i] };
+			v.worldPosition = { worldX[i], worldY[i], worldZ[i] };
+			return v;
+		}
+
+		std::vector<float> clipX{};
+		std::vector<float> clipY{};
+		std::vector<float> clipZ{};
+		std::vector<float> clipW{};
+
+		// After the perspective divide and viewport transform, only meaningful for vertices in front of the near plane
+		std::vector<float> screenX{};
+		std::vector<float> screenY{};
+		std::vector<float> depth{};
+		std::vector<float> invW{};
+
+		// World space
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+		std::vector<float> worldX{};
+		std::vector<float> worldY{};
+		std::vector<float> worldZ{};
+	};
+}
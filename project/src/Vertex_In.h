@@ -16,10 +16,11 @@ namespace dae
 
 	struct Vertex_Out
 	{
-		Vector4 position{};
+		Vector4 position{}; // Clip space
 		Vector2 texcoord{};
 		Vector3 normal{};
 		Vector3 tangent{};
+		Vector3 worldPosition{};
 	};
 }
 
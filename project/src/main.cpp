@@ -103,6 +103,38 @@ int main(int argc, char* args[])
 				{
 					pRenderer->ToggleUniformClearColor();
 				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F12)
+				{
+					pRenderer->ChangeRenderPath();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_P)
+				{
+					pRenderer->ToggleFramePipelining();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_M)
+				{
+					pRenderer->ToggleMSAA();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_V)
+				{
+					pRenderer->ToggleVariableRateShading();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_R)
+				{
+					pRenderer->ToggleDynamicResolution();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_T)
+				{
+					pRenderer->ChangeFrameTimeTarget();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_L)
+				{
+					pRenderer->ToggleTexelLayout();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_B)
+				{
+					pRenderer->BenchmarkRenderPaths();
+				}
 				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
 				{
 					displayFPS = !displayFPS;
@@ -136,7 +168,16 @@ int main(int argc, char* args[])
 			printTimer = 0.f;
 			if (displayFPS)
 			{
-				std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+				std::cout << "dFPS: " << pTimer->GetdFPS();
+				if (int const latency{ pRenderer->GetFrameLatency() }; latency > 0)
+				{
+					std::cout << " (+" << latency << " frame latency, " << latency * 1000.f / pTimer->GetdFPS() << " ms)";
+				}
+				if (float const renderScale{ pRenderer->GetRenderScale() }; renderScale < 1.f)
+				{
+					std::cout << " (rendering at " << static_cast<int>(renderScale * 100.f + 0.5f) << "% resolution)";
+				}
+				std::cout << std::endl;
 			}
 		}
 	}
@@ -156,15 +197,23 @@ void PrintSettings() noexcept
 
 	std::cout << "[F1]: Toggle Rasterizer Mode (Software - Hardware)\n";
 	std::cout << "[F2]: Toggle Rotation Mode\n";
-	std::cout << "[F3]: Toggle Display Fire Mesh ("<< RED << "Only works for hardware"<< YELLOW << ", not displayed in software rasterizer)\n";
-	std::cout << "[F4]: Cycle Sampler Mode (" << RED << "Only works for hardware"<< YELLOW <<")\n";
+	std::cout << "[F3]: Toggle Display Fire Mesh\n";
+	std::cout << "[F4]: Cycle Sampler Mode\n";
 	std::cout << "[F5]: Cycle Shading Mode (" << RED << "Only works for software"<< YELLOW <<")\n";
 	std::cout << "[F6]: Toggle Normal Mapping (" << RED << "Only works for software" << YELLOW << ")\n";
 	std::cout << "[F7]: Toggle Display Depth Buffer (" << RED << "Only works for software" << YELLOW << ")\n";
 	std::cout << "[F8]: Toggle Display Bounding Boxes (" << RED << "Only works for software" << YELLOW << ")\n";
 	std::cout << "[F9]: Cycle Cull Mode\n";
 	std::cout << "[F10]: Toggle Uniform Display Colour\n";
-	std::cout << "[F11]: Toggle Display FPS\n\n";
+	std::cout << "[F11]: Toggle Display FPS\n";
+	std::cout << "[F12]: Cycle Render Path (" << RED << "Only works for software" << YELLOW << ")\n";
+	std::cout << "[P]: Toggle Frame Pipelining (" << RED << "Only works for software" << YELLOW << ", adds a frame of latency)\n";
+	std::cout << "[M]: Toggle 4x MSAA (" << RED << "Only works for software" << YELLOW << ")\n";
+	std::cout << "[V]: Toggle Variable Rate Shading (" << RED << "Only works for software" << YELLOW << ", shades flat areas once per 1x2, 2x2 or 4x4 pixels)\n";
+	std::cout << "[R]: Toggle Dynamic Resolution (" << RED << "Only works for software" << YELLOW << ", lowers the resolution to hit the frame time target)\n";
+	std::cout << "[T]: Cycle Frame Time Target of the Dynamic Resolution (" << RED << "Only works for software" << YELLOW << ")\n";
+	std::cout << "[L]: Toggle Morton Texel Layout (" << RED << "Only works for software" << YELLOW << ", stores texels in Z-order for better cache use)\n";
+	std::cout << "[B]: Benchmark the Render Paths with and without MSAA, and the Texel Layouts (" << RED << "Only works for software" << YELLOW << ")\n\n";
 
 	std::cout << "[ARROWS | WASD]: Move\n";
 	std::cout << "[LSHIFT]: Sprint\n";